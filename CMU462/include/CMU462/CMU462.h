@@ -14,6 +14,8 @@ class Vector4D;
 class Matrix3x3;
 class Matrix4x4;
 
+template<class T> class BasicAffine2D;
+
 class Quaternion;
 class Complex;
 
@@ -0,0 +1,189 @@
+#ifndef CMU462_AFFINE2D_H
+#define CMU462_AFFINE2D_H
+
+#include "CMU462.h"
+#include "vector2D.h"
+#include "matrix3x3.h"
+
+#include <cmath>
+
+namespace CMU462 {
+
+/**
+ * Defines a 2D affine transformation, i.e., a 2D homogeneous transformation
+ * whose last row is (0,0,1).  Only the top two rows are stored, so that
+ * composing two transformations or transforming a point takes less than
+ * half the arithmetic of the equivalent Matrix3x3 operations, and requires
+ * no projective divide.  The scalar type T is either double (Affine2D) or
+ * float (Affine2Df).
+ */
+template<class T>
+class BasicAffine2D {
+
+  public:
+
+  // The default constructor (leaves the entries uninitialized).
+  BasicAffine2D( void ) { }
+
+  // Constructor from the top two rows, in row major order.
+  BasicAffine2D( T a00, T a01, T a02,
+                 T a10, T a11, T a12 ) {
+    entries[0][0] = a00; entries[0][1] = a01; entries[0][2] = a02;
+    entries[1][0] = a10; entries[1][1] = a11; entries[1][2] = a12;
+  }
+
+  // Converts from an affine transformation with a different scalar type.
+  template<class S>
+  explicit BasicAffine2D( const BasicAffine2D<S>& A ) {
+    for( int i = 0; i < 2; i++ )
+    for( int j = 0; j < 3; j++ )
+    {
+       entries[i][j] = (T) A(i,j);
+    }
+  }
+
+  // Converts from a 2D homogeneous transformation,
+  // whose last row is assumed to be (0,0,1).
+  explicit BasicAffine2D( const Matrix3x3& A ) {
+    for( int i = 0; i < 2; i++ )
+    for( int j = 0; j < 3; j++ )
+    {
+       entries[i][j] = (T) A(i,j);
+    }
+  }
+
+  /**
+   * Returns the equivalent 2D homogeneous transformation.
+   */
+  Matrix3x3 toMatrix3x3( void ) const {
+    Matrix3x3 B;
+
+    B(0,0) = entries[0][0]; B(0,1) = entries[0][1]; B(0,2) = entries[0][2];
+    B(1,0) = entries[1][0]; B(1,1) = entries[1][1]; B(1,2) = entries[1][2];
+    B(2,0) = 0.;            B(2,1) = 0.;            B(2,2) = 1.;
+
+    return B;
+  }
+
+  /**
+   * Returns the identity transformation.
+   */
+  static BasicAffine2D identity( void ) {
+    return BasicAffine2D( 1, 0, 0,
+                          0, 1, 0 );
+  }
+
+  /**
+   * Returns the translation by the vector t.
+   */
+  static BasicAffine2D translation( const Vector2D& t ) {
+    return BasicAffine2D( 1, 0, t.x,
+                          0, 1, t.y );
+  }
+
+  /**
+   * Returns the rotation by the angle theta (in radians) around the origin,
+   * with the same orientation as Matrix3x3::rotation().
+   */
+  static BasicAffine2D rotation( double theta ) {
+    const T c = cos( theta );
+    const T s = sin( theta );
+
+    return BasicAffine2D(  c, s, 0,
+                          -s, c, 0 );
+  }
+
+  /**
+   * Returns the rotation by the angle theta (in radians) around the point p,
+   * i.e., translation( p ) * rotation( theta ) * translation( -p ), computed
+   * in closed form.
+   */
+  static BasicAffine2D rotation( double theta, const Vector2D& p ) {
+    const T c = cos( theta );
+    const T s = sin( theta );
+    const T x = p.x;
+    const T y = p.y;
+
+    return BasicAffine2D(  c, s, x - c*x - s*y,
+                          -s, c, y + s*x - c*y );
+  }
+
+  /**
+   * Returns the rotation encoded by this transformation as an angle
+   * in radians (see Matrix3x3::getRotation()).
+   */
+  double getRotation( void ) const {
+    return atan2( (double) entries[0][1], (double) entries[0][0] );
+  }
+
+  /**
+   * Returns the translation encoded by this transformation,
+   * i.e., the image of the origin.
+   */
+  Vector2D getTranslation( void ) const {
+    return Vector2D( entries[0][2], entries[1][2] );
+  }
+
+  /**
+   * Returns the inverse transformation.
+   */
+  BasicAffine2D inv( void ) const {
+    const T (&A)[3] = entries[0];
+    const T (&B)[3] = entries[1];
+
+    const T invDet = T(1) / ( A[0]*B[1] - A[1]*B[0] );
+    const T a00 =  B[1]*invDet, a01 = -A[1]*invDet;
+    const T a10 = -B[0]*invDet, a11 =  A[0]*invDet;
+
+    return BasicAffine2D( a00, a01, -( a00*A[2] + a01*B[2] ),
+                          a10, a11, -( a10*A[2] + a11*B[2] ) );
+  }
+
+  // accesses element (i,j) of the top two rows using 0-based indexing
+        T& operator()( int i, int j )       { return entries[i][j]; }
+  const T& operator()( int i, int j ) const { return entries[i][j]; }
+
+  // returns A*B, i.e., the transformation that applies B first and then A
+  BasicAffine2D operator*( const BasicAffine2D& B ) const {
+    const T (&a)[2][3] = entries;
+    const T (&b)[2][3] = B.entries;
+
+    return BasicAffine2D( a[0][0]*b[0][0] + a[0][1]*b[1][0],
+                          a[0][0]*b[0][1] + a[0][1]*b[1][1],
+                          a[0][0]*b[0][2] + a[0][1]*b[1][2] + a[0][2],
+                          a[1][0]*b[0][0] + a[1][1]*b[1][0],
+                          a[1][0]*b[0][1] + a[1][1]*b[1][1],
+                          a[1][0]*b[0][2] + a[1][1]*b[1][2] + a[1][2] );
+  }
+
+  // transforms the point p
+  Vector2D operator*( const Vector2D& p ) const {
+    const T x = p.x;
+    const T y = p.y;
+
+    return Vector2D( entries[0][0]*x + entries[0][1]*y + entries[0][2],
+                     entries[1][0]*x + entries[1][1]*y + entries[1][2] );
+  }
+
+  // transforms the direction v, i.e., ignores the translation
+  Vector2D transformDirection( const Vector2D& v ) const {
+    const T x = v.x;
+    const T y = v.y;
+
+    return Vector2D( entries[0][0]*x + entries[0][1]*y,
+                     entries[1][0]*x + entries[1][1]*y );
+  }
+
+  protected:
+
+  // top two rows, in row major order
+  T entries[2][3];
+
+}; // class BasicAffine2D
+
+typedef BasicAffine2D<double> Affine2D;
+typedef BasicAffine2D<float>  Affine2Df;
+
+} // namespace CMU462
+
+#endif // CMU462_AFFINE2D_H
@@ -14,6 +14,20 @@ using namespace std;
 const double simulationFramesPerSecond = 60.;
 const double simulationTimestep = 1. / simulationFramesPerSecond;
 
+// Number of frames between checkpoints of the dynamic state, i.e., the
+// largest number of frames replayed when seeking to an arbitrary frame.
+const int dynamicsCheckpointInterval = 30;
+
+// Largest number of simulation steps taken per rendered frame, i.e., the
+// lowest display rate (simulationFramesPerSecond / this number) at which
+// playback still proceeds in real time.
+const int maxSimulationStepsPerRender = 4;
+
+// Largest deviation from the original animation allowed when removing
+// redundant knots (see Animator::reduceKeyFrames()).
+const double keyFrameAngleTolerance = .005; // radians
+const double keyFramePositionTolerance = .5; // pixels
+
 namespace CMU462
 {
 
@@ -41,47 +55,60 @@ namespace CMU462
       text_drawer.init(use_hdpi);
       b_HUD = true;
       cursor_moving_element = false;
+
+      simulationClock = SimulationClock( simulationTimestep, maxSimulationStepsPerRender );
+      renderTimer.start();
+
+      simulatedFrame = 0;
+      checkpoints.setInterval( dynamicsCheckpointInterval );
    }
 
    // The root of all drawing calls in this project.
    void Animator::render()
    {
-      double time = timeline.getCurrentFrame();
-      static double lastTime = time;
+      renderTimer.stop();
+      double elapsed = renderTimer.duration();
+      renderTimer.start();
+
+      // During playback (but not while dragging a joint with IK, which
+      // keys the current frame continuously), characters are updated from
+      // baked tables, which only need to be recomputed after an edit.
+      if( timeline.isCurrentlyPlaying() && !followCursor )
+      {
+         bakeActors( timeline.getMaxFrame(), true );
+      }
 
-      if( time != lastTime )
+      // During playback, the timeline advances with the simulation, which
+      // takes as many fixed steps as the wall-clock time since the last call
+      // allows; the display then lags the simulation by the fraction of a
+      // step left over, interpolating between the last two simulated states.
+      double dynamicsBlend = 1.;
+      if( timeline.isCurrentlyPlaying() )
       {
-         if( time == 0 )
-         {
-            for( vector<Character>::iterator character = actors.begin(); character != actors.end(); character++ )
-            {
-               for( vector<Joint*>::iterator j = character->joints.begin(); j != character->joints.end(); j++ )
-               {
-                  (*j)->resetDynamics();
-               }
-            }
-         }
+         int nSteps = simulationClock.advance( elapsed );
+         for( int k = 0; k < nSteps && stepSimulation(); k++ );
 
-         if( time == lastTime+1 )
+         if( timeline.isCurrentlyPlaying() && timeline.getCurrentFrame() > 0 )
          {
-            for( vector<Character>::iterator character  = actors.begin();
-                  character != actors.end();
-                  character++ )
-            {
-               character->integrate( time, simulationTimestep );
-            }
+            dynamicsBlend = simulationClock.getBlend();
          }
       }
+      else
+      {
+         // Otherwise the timeline is at rest, or has been moved by hand.
+         simulationClock.reset();
+         simulateTo( timeline.getCurrentFrame() );
+      }
 
-      enter_2D_GL_draw_mode();
+      // Display the (keyframed) animation at the same point in time.
+      double time = timeline.getCurrentFrame() - ( 1. - dynamicsBlend );
 
-      //==========================================
-      // FIXME: Separate rendering from updating.
-      timeline.step();
-      //==========================================
+      enter_2D_GL_draw_mode();
 
       renderer->clear( Color( .6, .6, .9, 0. ) );
 
+      updateActors( time, dynamicsBlend );
+
       // Draw each character in they order they appear in the "actors"
       // list.  Note that this ordering effectivly determines the layering/
       // occlusion of objects in the scene.
@@ -90,7 +117,6 @@ namespace CMU462
             character ++ )
       {
          bool pick = false;
-         character->update( time );
          character->draw( renderer, pick, hoveredJoint, selectedJoint );
       }
 
@@ -105,8 +131,10 @@ namespace CMU462
       // As long as the right mouse button is being held down, apply IK optimization.
       // Note that this code must be run here in the (so-called) "render" method, because
       // this method is updated every frame, independent of whether the cursor is moving,
-      // etc.  By calling Character::reachForTarget() here, the IK optimization is run
-      // continuously (rather than just during cursor/click/key events).
+      // etc.  The optimization itself runs on the IK worker's thread, which spends a
+      // fixed time budget per frame on the current cursor position (and sleeps once it
+      // has converged); here we only hand it the cursor and key the poses it publishes,
+      // so that a slow solve never holds up drawing.
       if( followCursor )
       {
          // draw round points
@@ -118,8 +146,19 @@ namespace CMU462
          double time = timeline.getCurrentFrame();
          if( selectedJoint && selectedJointCharacter )
          {
-            selectedJointCharacter->reachForTarget( selectedJoint, ikSourcePoint, cursorPoint, time );
-            timeline.markTime((int)time);
+            if( !ikWorkerStarted || time != ikWorkerTime )
+            {
+               selectedJointCharacter->update( time );
+               ikWorker.start( *selectedJointCharacter, selectedJoint, ikSourcePoint );
+               ikWorkerStarted = true;
+               ikWorkerTime = time;
+            }
+            ikWorker.setTarget( cursorPoint );
+
+            if( keyIKWorkerPose( time ) )
+            {
+               timeline.markTime((int)time);
+            }
 
             if( showDebugWidgets )
             {
@@ -136,10 +175,82 @@ namespace CMU462
 
 
       exit_2D_GL_draw_mode();
+   }
+
+   void Animator::updateActors( double time, double dynamicsBlend )
+   {
+      const int nActors = actors.size();
+
+      #pragma omp parallel for schedule( static )
+      for( int i = 0; i < nActors; i++ )
+      {
+         actors[i].update( time, dynamicsBlend );
+      }
+   }
+
+   bool Animator::stepSimulation( void )
+   {
+      if( !timeline.step() )
+      {
+         return false;
+      }
+
+      // (If the timeline looped back to the start,
+      // this restores the state at frame 0.)
+      simulateTo( timeline.getCurrentFrame() );
+      return true;
+   }
+
+   void Animator::simulateTo( int frame )
+   {
+      // After an edit, the current state of the simulation is stale too.
+      bool invalidated = checkpoints.validate( actors );
+
+      // Unless the simulation is about to reach the frame anyway,
+      // start from the latest known state before it.
+      int start = checkpoints.find( frame );
+      if( invalidated || frame < simulatedFrame || start > simulatedFrame )
+      {
+         checkpoints.restore( start, actors );
+         simulatedFrame = start;
+      }
 
-      lastTime = time;
+      while( simulatedFrame < frame )
+      {
+         updateActors( simulatedFrame );
+         integrateActors( simulatedFrame, simulationTimestep );
+         simulatedFrame++;
 
+         checkpoints.record( simulatedFrame, actors );
+      }
+   }
 
+   void Animator::integrateActors( double time, double timestep )
+   {
+      // The pendulums of all actors are stepped together, a few per SIMD register.
+      integrateBatched( actors, time, timestep, pendulumBatch );
+   }
+
+   void Animator::bakeActors( int nFrames, bool onlyIfStale )
+   {
+      const int nActors = actors.size();
+
+      // Bakes read the published splines, so first publish any edits
+      // not yet published (e.g., by code that keys splines directly).
+      for( int i = 0; i < nActors; i++ )
+      {
+         actors[i].publishSplines();
+      }
+
+      // (Bakes vary widely in cost, so actors are handed out one at a time.)
+      #pragma omp parallel for schedule( dynamic, 1 )
+      for( int i = 0; i < nActors; i++ )
+      {
+         if( !onlyIfStale || !actors[i].isBaked( nFrames ) )
+         {
+            actors[i].bake( nFrames );
+         }
+      }
    }
 
    void Animator::render_frames()
@@ -159,6 +270,15 @@ namespace CMU462
       // output parameters
       const size_t frame_total = timeline.getMaxFrame();
 
+      // bake all keyframed motion, so that each frame is a table lookup
+      bakeActors( frame_total, false );
+      for( vector<Character>::iterator character = actors.begin(); character != actors.end(); character++ )
+      {
+         fprintf(stdout, "Baked character %lu: max interpolation error %g rad (angles), %g px (position)\n",
+                 (unsigned long)( character - actors.begin() ),
+                 character->bakedAngleError, character->bakedPositionError);
+      }
+
       glReadBuffer(GL_BACK);
       glDrawBuffer(GL_BACK);
 
@@ -184,20 +304,8 @@ namespace CMU462
          time = frame_count;
 
          // Update character state for the current time step
-         for( vector<Character>::iterator character  = actors.begin();
-               character != actors.end();
-               character ++ )
-         {
-            character->update( time );
-         }
-
-         // Update characters
-         for( vector<Character>::iterator character  = actors.begin();
-               character != actors.end();
-               character++ )
-         {
-            character->integrate( time, simulationTimestep );
-         }
+         simulateTo( frame_count );
+         updateActors( time );
 
          // Draw each character in they order they appear in the "actors"
          // list.  Note that this ordering effectivly determines the layering/
@@ -240,15 +348,17 @@ namespace CMU462
    void Animator :: drawIKDebugWidgets( void )
    {
       // draw source and target IK points
-      Vector3D p( ikSourcePoint.x, ikSourcePoint.y, 1. );
-      p = selectedJoint->currentTransformation * p;
+      Vector2D p = selectedJoint->currentTransformation * ikSourcePoint;
       glPointSize( 25. );
       glBegin( GL_POINTS );
       glColor4f( 0., 0., 1., 1. ); glVertex2d( cursorPoint.x, cursorPoint.y );
-      glColor4f( 1., 0., 0., 1. ); glVertex2d( p.x/p.z, p.y/p.z );
+      glColor4f( 1., 0., 0., 1. ); glVertex2d( p.x, p.y );
       glEnd();
 
-      // visualize gradients of IK energy
+      // visualize gradients of IK energy (computed here, since
+      // the IK worker solves on its own copy of the character)
+      Vector2D source = p, target = cursorPoint;
+      selectedJointCharacter->root->calculateAngleGradient( selectedJoint, source, target );
       for( vector<Joint*>::iterator j = selectedJointCharacter->joints.begin(); j != selectedJointCharacter->joints.end(); j++ )
       {
          const double gradientLengthScale = 2000.;
@@ -312,6 +422,8 @@ namespace CMU462
       glEnable( GL_POINT_SMOOTH );
       glHint( GL_POINT_SMOOTH_HINT, GL_NICEST );
 
+      splinePaths.resize( actors.size() );
+
       for( vector<Character>::iterator character = actors.begin(); character != actors.end(); character++ )
       {
          bool selected = ( &*character == selectedCharacter );
@@ -322,15 +434,17 @@ namespace CMU462
          // approximate spline by line segments
          const double maxTime = timeline.getMaxFrame();
          Vector2D c = character->root->center;
+         SplinePath& path( splinePaths[ character - actors.begin() ] );
+         updateSplinePath( path, spline, c, maxTime, 1./nSamplesPerTick );
+
          glLineWidth( 3. );
          glColor4f( 1., 1., 1., alpha );
-         glBegin( GL_LINE_STRIP );
-         for( double t = 0; t <= maxTime; t += 1./nSamplesPerTick )
-         {
-            Vector2D p = spline( t ) + c;
-            glVertex2d( p.x, p.y );
-         }
-         glEnd();
+         glBindBuffer( GL_ARRAY_BUFFER, path.buffer );
+         glEnableClientState( GL_VERTEX_ARRAY );
+         glVertexPointer( 2, GL_DOUBLE, sizeof( Vector2D ), 0 );
+         glDrawArrays( GL_LINE_STRIP, 0, path.vertices.size() );
+         glDisableClientState( GL_VERTEX_ARRAY );
+         glBindBuffer( GL_ARRAY_BUFFER, 0 );
 
          if( selected )
          {
@@ -347,9 +461,10 @@ namespace CMU462
             for( Spline<Vector2D>::KnotCIter k  = spline.knots.begin(); k != spline.knots.end(); k++ )
             {
                double t = k->first;
+               Spline<Vector2D>::Sample sample = spline.evaluateAll( t );
                Vector2D P = c + k->second; // position
-               Vector2D T = tangentLengthScale * spline.evaluate( t, 1 ); // tangent
-               Vector2D A = tangentLengthScale * spline.evaluate( t, 2 ); // acceleration
+               Vector2D T = tangentLengthScale * sample.d1; // tangent
+               Vector2D A = tangentLengthScale * sample.d2; // acceleration
 
                glColor4f( 1., 1., 1., alpha );
                glPointSize( controlPointScale );
@@ -369,6 +484,106 @@ namespace CMU462
       glPopAttrib();
    }
 
+   void Animator::updateSplinePath( SplinePath& path,
+                                    Spline<Vector2D>& spline,
+                                    Vector2D offset,
+                                    double maxTime,
+                                    double spacing )
+   {
+      const size_t nSamples = (size_t) floor( maxTime/spacing ) + 1;
+
+      // Any change in sampling requires resampling the whole path.
+      bool resampleAll = path.buffer == 0 ||
+                         path.times.size() != nSamples ||
+                         path.spacing != spacing ||
+                         path.offset.x != offset.x ||
+                         path.offset.y != offset.y;
+
+      if( !resampleAll && path.version == spline.getVersion() )
+      {
+         return;
+      }
+
+      spline.compile();
+      const vector<double>& knotTimes = spline.getKnotTimes();
+      const vector<Vector2D>& knotValues = spline.getKnotValues();
+
+      // Determine the interval of time [start,end] that may have changed.
+      double start = -INFINITY;
+      double end = INFINITY;
+      if( !resampleAll )
+      {
+         const size_t nOld = path.knotTimes.size();
+         const size_t nNew = knotTimes.size();
+
+         // number of equal knots at the beginning...
+         size_t f = 0;
+         while( f < nOld && f < nNew &&
+                path.knotTimes[f] == knotTimes[f] &&
+                path.knotValues[f].x == knotValues[f].x &&
+                path.knotValues[f].y == knotValues[f].y ) f++;
+
+         // ...and at the end
+         size_t b = 0;
+         while( b < nOld-f && b < nNew-f &&
+                path.knotTimes[nOld-1-b] == knotTimes[nNew-1-b] &&
+                path.knotValues[nOld-1-b].x == knotValues[nNew-1-b].x &&
+                path.knotValues[nOld-1-b].y == knotValues[nNew-1-b].y ) b++;
+
+         // The tangents at the two knots on either side of the modified
+         // knots also changed, so the curve changed from the second unmodified
+         // knot before them to the second unmodified knot after them.
+         if( f >= 2 ) start = knotTimes[f-2];
+         if( b >= 2 ) end = knotTimes[nNew-b+1];
+      }
+
+      path.version = spline.getVersion();
+      path.offset = offset;
+      path.spacing = spacing;
+      path.knotTimes = knotTimes;
+      path.knotValues = knotValues;
+
+      if( resampleAll )
+      {
+         path.times.resize( nSamples );
+         path.vertices.resize( nSamples );
+         for( size_t k = 0; k < nSamples; k++ )
+         {
+            path.times[k] = k*spacing;
+         }
+      }
+
+      // Resample within the modified interval.
+      size_t k0 = start < 0. ? 0 : (size_t) ceil( start/spacing );
+      size_t k1 = end >= maxTime ? nSamples : min( nSamples, (size_t) floor( end/spacing ) + 1 );
+      if( k0 >= k1 )
+      {
+         return;
+      }
+
+      spline.evaluateMany( &path.times[k0], &path.vertices[k0], k1-k0 );
+      for( size_t k = k0; k < k1; k++ )
+      {
+         path.vertices[k] += offset;
+      }
+
+      // Upload the modified vertices.
+      if( path.buffer == 0 )
+      {
+         glGenBuffers( 1, &path.buffer );
+      }
+      glBindBuffer( GL_ARRAY_BUFFER, path.buffer );
+      if( resampleAll )
+      {
+         glBufferData( GL_ARRAY_BUFFER, nSamples*sizeof( Vector2D ), &path.vertices[0], GL_DYNAMIC_DRAW );
+      }
+      else
+      {
+         glBufferSubData( GL_ARRAY_BUFFER, k0*sizeof( Vector2D ), (k1-k0)*sizeof( Vector2D ), &path.vertices[k0] );
+      }
+      glBindBuffer( GL_ARRAY_BUFFER, 0 );
+   }
+
    void Animator::resize( size_t width, size_t height ) {
 
       this->width  = width;
@@ -441,6 +656,43 @@ namespace CMU462
                       }
                       break;
 
+                      // Remove redundant knots.
+            case 'r':
+            case 'R':
+                      reduceKeyFrames();
+                      break;
+            case 'k':
+            case 'K':
+                      reduceKeyFramesAfterIK = !reduceKeyFramesAfterIK;
+                      break;
+
+                      // Change the scheme used to simulate dynamic joints.
+            case 'i':
+            case 'I':
+                      setIntegrator( actors.empty() ? SYMPLECTIC_EULER :
+                            (Integrator) ( ( actors[0].integrator + 1 ) % N_INTEGRATORS ),
+                            actors.empty() ? 1 : actors[0].substeps );
+                      break;
+            case '-':
+                      if( !actors.empty() && actors[0].substeps > 1 )
+                      {
+                         setIntegrator( actors[0].integrator, actors[0].substeps / 2 );
+                      }
+                      break;
+            case '=':
+                      if( !actors.empty() )
+                      {
+                         setIntegrator( actors[0].integrator, actors[0].substeps * 2 );
+                      }
+                      break;
+
+                      // Change the method used to solve IK.
+            case 'j':
+            case 'J':
+                      setIKSolver( actors.empty() ? GRADIENT_DESCENT :
+                            (IKSolver) ( ( actors[0].ikSolver + 1 ) % N_IK_SOLVERS ) );
+                      break;
+
             case '[':
                       timeline.makeShorter(100);
                       break;
@@ -452,6 +704,31 @@ namespace CMU462
 
    }
 
+   void Animator :: setIntegrator( Integrator integrator, int substeps )
+   {
+      for( vector<Character>::iterator character = actors.begin(); character != actors.end(); character++ )
+      {
+         character->integrator = integrator;
+         character->substeps = substeps;
+      }
+
+      cerr << "[Animator] Integrator: " << integratorName( integrator )
+           << ", " << substeps << " substep(s) per frame" << endl;
+   }
+
+   void Animator :: setIKSolver( IKSolver solver )
+   {
+      for( vector<Character>::iterator character = actors.begin(); character != actors.end(); character++ )
+      {
+         character->ikSolver = solver;
+      }
+
+      // Restart any IK in progress with the new solver.
+      ikWorkerStarted = false;
+
+      cerr << "[Animator] IK solver: " << ikSolverName( solver ) << endl;
+   }
+
    Joint* Animator :: pickJoint( float x, float y )
    {
       // Initially assume that there is no joint under the cursor, and
@@ -606,6 +883,8 @@ namespace CMU462
 
          Spline<Vector2D> & pos = C.position;
          pos.setValue(time, pos.evaluate(time));
+
+         C.publishSplines();
       }
 
    }
@@ -628,11 +907,93 @@ namespace CMU462
 
          Spline<Vector2D> & pos = C.position;
          pos.removeKnot(time, .1); // Assuming times are on the integers.
+
+         C.publishSplines();
       }
 
    }
 
 
+   // Inserts the (integer) times of all knots in the given spline into the given set.
+   template <class T>
+   static void collectKnotTimes( const Spline<T>& spline, set<int>& times )
+   {
+      for( typename Spline<T>::KnotCIter k = spline.knots.begin(); k != spline.knots.end(); k++ )
+      {
+         times.insert( (int) k->first );
+      }
+   }
+
+   void Animator::reduceKeyFrames( void )
+   {
+      set<int> timesBefore, timesAfter;
+      size_t nRemoved = 0;
+
+      for( vector<Character>::iterator C_iter = actors.begin(); C_iter != actors.end(); C_iter++ )
+      {
+         Character & C = *C_iter;
+         for( vector<Joint*>::iterator iter = C.joints.begin(); iter != C.joints.end(); iter++ )
+         {
+            Spline<double> & angle = (*iter)->getAngleSpline();
+            collectKnotTimes( angle, timesBefore );
+            nRemoved += angle.reduceKnots( keyFrameAngleTolerance );
+            collectKnotTimes( angle, timesAfter );
+         }
+
+         collectKnotTimes( C.position, timesBefore );
+         nRemoved += C.position.reduceKnots( keyFramePositionTolerance );
+         collectKnotTimes( C.position, timesAfter );
+
+         C.publishSplines();
+      }
+
+      // Unmark the frames where no spline has a knot anymore.
+      size_t nUnmarked = 0;
+      for( set<int>::iterator t = timesBefore.begin(); t != timesBefore.end(); t++ )
+      {
+         if( timesAfter.count( *t ) == 0 && timeline.unmarkTime( *t ) )
+         {
+            nUnmarked++;
+         }
+      }
+
+      cerr << "[Animator] Removed " << nRemoved << " redundant knots and unmarked "
+           << nUnmarked << " key frames." << endl;
+   }
+
+   bool Animator::keyIKWorkerPose( double time )
+   {
+      if( !ikWorker.fetch( ikWorkerAngles ) )
+      {
+         return false;
+      }
+
+      vector<IKConstraint> constraints( 1, IKConstraint( selectedJoint, ikSourcePoint, cursorPoint ) );
+      selectedJointCharacter->keyIKSolution( constraints, ikWorkerAngles, time );
+      selectedJointCharacter->publishSplines();
+      return true;
+   }
+
+   void Animator::stopFollowingCursor( void )
+   {
+      if( ikWorkerStarted )
+      {
+         // Keep the last pose the worker found.
+         if( selectedJoint && selectedJointCharacter && keyIKWorkerPose( ikWorkerTime ) )
+         {
+            timeline.markTime( (int) ikWorkerTime );
+         }
+         ikWorker.stop();
+         ikWorkerStarted = false;
+      }
+
+      if( followCursor && reduceKeyFramesAfterIK )
+      {
+         reduceKeyFrames();
+      }
+      followCursor = false;
+   }
+
    // FIXME : This code is the same as the helpful decomposition in p3.
    //         We should probably put this function in the standard library.
    //         I think that we should inherit mouse_pressed(), released() etc
@@ -682,7 +1043,7 @@ namespace CMU462
       {
          case LEFT:
             leftDown = true;
-            followCursor = false;
+            stopFollowingCursor();
             if( timeline.mouse_click( cursorPoint.x, cursorPoint.y ) )
             {
                draggingTimeline = true;
@@ -720,7 +1081,7 @@ namespace CMU462
             }
             else
             {
-               followCursor = false;
+               stopFollowingCursor();
             }
             break;
          case MIDDLE:
@@ -738,9 +1099,7 @@ namespace CMU462
 
          // determine where the point we clicked on would have
          // been in the pre-transformed coordinate system
-         Vector3D p( mouseDownPosition.x, mouseDownPosition.y, 1. );
-         p = selectedJoint->currentTransformation.inv() * p;
-         ikSourcePoint = Vector2D( p.x/p.z, p.y/p.z );
+         ikSourcePoint = selectedJoint->currentTransformation.inv() * mouseDownPosition;
       }
       else
       {
@@ -842,9 +1201,10 @@ namespace CMU462
 
       if( selectedJointCharacter )
       {
-         m4 << "position: " << selectedJointCharacter->position(time);
-         m5 << "velocity: " << selectedJointCharacter->position.evaluate(time,1);
-         m6 << "acceleration: " << selectedJointCharacter->position.evaluate(time,2);
+         Spline<Vector2D>::Sample sample = selectedJointCharacter->position.evaluateAll(time);
+         m4 << "position: " << sample.value;
+         m5 << "velocity: " << sample.d1;
+         m6 << "acceleration: " << sample.d2;
       }
 
       const size_t size = 12;
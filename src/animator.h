@@ -23,6 +23,11 @@
 #include "timeline.h"
 #include "svg_renderer.h"
 #include "hardware_renderer.h"
+#include "simulation_clock.h"
+#include "dynamics_checkpoints.h"
+#include "ik_worker.h"
+#include "pendulum_batch.h"
+#include "CMU462/timer.h"
 
 using namespace std;
 
@@ -44,6 +49,8 @@ namespace CMU462 {
            selectedCharacter( NULL ),
            showDebugWidgets( true ),
            followCursor( false ),
+           ikWorkerStarted( false ),
+           reduceKeyFramesAfterIK( false ),
            draggingTimeline( false ),
            cursor_moving_element( false )
          {
@@ -122,6 +129,54 @@ namespace CMU462 {
          // The stored array of characters.
          vector<Character> actors;
 
+         // Updates or integrates every actor.  Actors are independent, so when
+         // OpenMP is enabled updates run in parallel, with each actor handled
+         // entirely by a single thread; the results are hence bit-identical to
+         // running the loop serially.  Integration instead steps the dynamic
+         // joints of all actors together in pendulumBatch (see integrateBatched()).
+         void updateActors( double time, double dynamicsBlend = 1. );
+         void integrateActors( double time, double timestep );
+         PendulumBatch pendulumBatch;
+
+         // Advances the timeline by one frame, and simulates the dynamic
+         // joints of every actor up to the new frame.  Returns false (without
+         // simulating) if the timeline has stopped playing.
+         bool stepSimulation( void );
+
+         // Brings the dynamic state of every actor to the given frame,
+         // replaying the simulation from the latest checkpoint (or from
+         // the start) if the frame is not simulatedFrame or just after it,
+         // or if anything the simulation depends on changed since (see
+         // DynamicsCheckpoints::validate()).
+         void simulateTo( int frame );
+
+         // The frame whose dynamic state the actors currently hold.
+         int simulatedFrame;
+
+         // Checkpoints of the dynamic state, recorded by simulateTo().
+         DynamicsCheckpoints checkpoints;
+
+         // Steps the simulation at a fixed rate during playback (one step per
+         // frame, at simulationFramesPerSecond), no matter how often render()
+         // is called, capping the number of steps that are caught up on per call.
+         SimulationClock simulationClock;
+
+         // Measures the wall-clock time between calls to render().
+         Timer renderTimer;
+
+         // Sets the integrator and number of substeps used to simulate the
+         // dynamic joints of every actor (see Character::integrator).
+         void setIntegrator( Integrator integrator, int substeps );
+
+         // Sets the method used to solve IK for every actor.
+         void setIKSolver( IKSolver solver );
+
+         // Bakes the first nFrames frames of every actor (see Character::bake()),
+         // in parallel when OpenMP is enabled, as updateActors() does.  If
+         // onlyIfStale is true, actors whose baked tables are current are not
+         // re-baked.
+         void bakeActors( int nFrames, bool onlyIfStale );
+
          Timeline timeline;
 
          // Internal event system (Copied from p3!!) //
@@ -165,6 +220,40 @@ namespace CMU462 {
 
          // visualization of interpolating splines
          void drawSplines( void );
+
+         // Polyline approximating the position spline of a character, as
+         // drawn by drawSplines().  It is cached in a vertex buffer between
+         // frames, and after an edit only the samples within the time
+         // interval influenced by the modified knots are recomputed.
+         struct SplinePath
+         {
+            SplinePath() : version( 0 ), spacing( 0. ), buffer( 0 ) {}
+
+            unsigned long version; // spline version when last sampled
+            Vector2D offset; // offset added to every sample
+            double spacing; // time between consecutive samples
+
+            // knots of the spline when last sampled, which are compared
+            // against the current knots to find the edited time interval
+            vector<double> knotTimes;
+            vector<Vector2D> knotValues;
+
+            // sample times and (offset) sample positions, also
+            // stored in the vertex buffer object "buffer"
+            vector<double> times;
+            vector<Vector2D> vertices;
+            GLuint buffer;
+         };
+
+         // one path per character, in the same order as "actors"
+         vector<SplinePath> splinePaths;
+
+         // Brings the given path up to date with the given spline.
+         void updateSplinePath( SplinePath& path,
+                                Spline<Vector2D>& spline,
+                                Vector2D offset,
+                                double maxTime,
+                                double spacing );
          void drawArrow( const Vector2D& from,
                          const Vector2D& to );
 
@@ -179,6 +268,19 @@ namespace CMU462 {
          // right-clicks
          bool followCursor;
 
+         // While following the cursor, IK is solved by a background worker,
+         // which is started on the selected character at the current frame
+         // (recorded in ikWorkerTime) and given the cursor as its target
+         // every frame.
+         IKWorker ikWorker;
+         bool ikWorkerStarted;
+         double ikWorkerTime;
+
+         // Keys the latest pose published by the IK worker (if any) into the
+         // selected character at the given time; returns true iff there was one.
+         bool keyIKWorkerPose( double time );
+         vector<double> ikWorkerAngles;
+
 		 // Adds a spline value to all characters and joints in the scene.
 		 // This is necessary for to ensure that artfully designed poses
 		 // are followed faithfully even if only a few parameters were modified.
@@ -187,6 +289,19 @@ namespace CMU462 {
 		 // Assumes all times are on the integers.
 		 void removeUniversalKeyFrame(double time);
 
+		 // Removes all knots (of every character's position and joint
+		 // angle splines) that the remaining knots reproduce to within a
+		 // fixed tolerance, and unmarks timeline frames left without knots.
+		 // This is mainly useful after IK dragging, which keys every frame.
+		 void reduceKeyFrames( void );
+
+		 // toggles whether reduceKeyFrames() runs automatically whenever
+		 // IK dragging (i.e., following the cursor) ends
+		 bool reduceKeyFramesAfterIK;
+
+		 // Stops IK dragging, reducing key frames if requested.
+		 void stopFollowingCursor( void );
+
 
 		 // HUD -- drawing functions.
 
@@ -0,0 +1,458 @@
+/*
+ * Implementation of the offline benchmarks.
+ */
+
+#include "benchmark.h"
+#include "character.h"
+#include "pendulum_batch.h"
+
+#include "CMU462/timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+
+// Each pendulum is simulated for this many frames (ten seconds of
+// animation), starting from rest at the given angle (in radians).
+const int benchmarkFrames = 600;
+const double benchmarkFramesPerSecond = 60.;
+const double benchmarkInitialAngle = .5;
+
+// The batched pendulums are those of this many copies of the character.
+const int benchmarkBatchCopies = 100;
+
+// Each IK solver is run on this many targets, each of which is where
+// the source point ends up when every keyframed joint angle is offset
+// by a random angle of at most the given size (in radians).  A solve
+// converges if it gets within the tolerance (in pixels) of the target
+// in at most the given number of iterations.
+const int benchmarkIKTargets = 500;
+const double benchmarkIKPerturbation = .5;
+const double benchmarkIKTolerance = .25;
+const int benchmarkIKMaxIterations = 100;
+
+// The IK bake follows a circle of the given radius (in pixels) around
+// the rest position of the source point, once every given number of
+// frames, for the given total number of frames.
+const int benchmarkIKBakeFrames = 10000;
+const int benchmarkIKBakePeriod = 240;
+const double benchmarkIKBakeRadius = 30.;
+
+namespace CMU462
+{
+   // Loads the character in the given file; returns false on failure.
+   static bool loadCharacter( const char* path, Character& character )
+   {
+      SVG svg;
+      if( SVGParser::load( path, &svg ) < 0 )
+      {
+         cerr << "[Animator] Could not load " << path << endl;
+         return false;
+      }
+
+      character.load_from_SVG( svg );
+      return true;
+   }
+
+   static double randomAngle( double maxAngle )
+   {
+      return maxAngle * ( 2. * rand() / RAND_MAX - 1. );
+   }
+
+   int benchmarkIntegrators( const char* path )
+   {
+      Character character;
+      if( !loadCharacter( path, character ) )
+      {
+         return -1;
+      }
+
+      // Every dynamic joint with some mass swings as a pendulum.
+      vector<Pendulum> pendulums;
+      for( size_t j = 0; j < character.joints.size(); j++ )
+      {
+         Joint* joint = character.joints[j];
+         if( joint->type == DYNAMIC )
+         {
+            Pendulum pendulum = joint->getPendulum( Vector2D( 0., 0. ) );
+            if( pendulum.energyScale() > 0. )
+            {
+               pendulums.push_back( pendulum );
+            }
+         }
+      }
+
+      printf( "%s: %d pendulums, %d frames at %g frames per second\n",
+              path, (int) pendulums.size(), benchmarkFrames, benchmarkFramesPerSecond );
+      if( pendulums.empty() )
+      {
+         return 0;
+      }
+
+      printf( "%-18s %8s %12s %14s %14s\n", "integrator", "substeps", "time (ms)", "max drift", "mean drift" );
+
+      const double timestep = 1. / benchmarkFramesPerSecond;
+      vector<double> theta( pendulums.size() );
+      vector<double> omega( pendulums.size() );
+
+      for( int i = 0; i < N_INTEGRATORS; i++ )
+      for( int substeps = 1; substeps <= 8; substeps *= 2 )
+      {
+         Integrator integrator = (Integrator) i;
+
+         theta.assign( pendulums.size(), benchmarkInitialAngle );
+         omega.assign( pendulums.size(), 0. );
+
+         // Frames are the outer loop, as in the animator.
+         Timer timer;
+         timer.start();
+         for( int frame = 0; frame < benchmarkFrames; frame++ )
+         {
+            for( size_t k = 0; k < pendulums.size(); k++ )
+            {
+               integratePendulum( pendulums[k], integrator, substeps, timestep, theta[k], omega[k] );
+            }
+         }
+         timer.stop();
+
+         // Energy drift relative to the scale of the potential energy.
+         double maxDrift = 0.;
+         double meanDrift = 0.;
+         for( size_t k = 0; k < pendulums.size(); k++ )
+         {
+            const Pendulum& p( pendulums[k] );
+            double drift = fabs( p.energy( theta[k], omega[k] ) - p.energy( benchmarkInitialAngle, 0. ) ) / p.energyScale();
+
+            maxDrift = max( maxDrift, drift );
+            meanDrift += drift / pendulums.size();
+         }
+
+         printf( "%-18s %8d %12.3f %14.3e %14.3e\n", integratorName( integrator ), substeps,
+                 1000. * timer.duration(), maxDrift, meanDrift );
+      }
+
+      return 0;
+   }
+
+   int benchmarkPendulumBatch( const char* path )
+   {
+      Character character;
+      if( !loadCharacter( path, character ) )
+      {
+         return -1;
+      }
+
+      vector<Pendulum> pendulums;
+      for( int copy = 0; copy < benchmarkBatchCopies; copy++ )
+      {
+         for( size_t j = 0; j < character.joints.size(); j++ )
+         {
+            if( character.joints[j]->type == DYNAMIC )
+            {
+               pendulums.push_back( character.joints[j]->getPendulum( Vector2D( 0., 0. ) ) );
+            }
+         }
+      }
+
+      printf( "%s: %d pendulums (%d copies), %d frames, %d lanes\n", path, (int) pendulums.size(),
+              benchmarkBatchCopies, benchmarkFrames, PendulumBatch::getLaneCount() );
+      if( pendulums.empty() )
+      {
+         return 0;
+      }
+
+      printf( "%-18s %8s %14s %14s %14s\n", "integrator", "substeps", "us/frame", "batched", "max difference" );
+
+      const double timestep = 1. / benchmarkFramesPerSecond;
+      vector<double> theta( pendulums.size() );
+      vector<double> omega( pendulums.size() );
+      PendulumBatch batch;
+
+      for( int i = 0; i < N_INTEGRATORS; i++ )
+      for( int substeps = 1; substeps <= 4; substeps *= 4 )
+      {
+         Integrator integrator = (Integrator) i;
+
+         theta.assign( pendulums.size(), benchmarkInitialAngle );
+         omega.assign( pendulums.size(), 0. );
+         Timer timer;
+         timer.start();
+         for( int frame = 0; frame < benchmarkFrames; frame++ )
+         {
+            for( size_t k = 0; k < pendulums.size(); k++ )
+            {
+               integratePendulum( pendulums[k], integrator, substeps, timestep, theta[k], omega[k] );
+            }
+         }
+         timer.stop();
+         double seconds = timer.duration();
+
+         batch.clear();
+         for( size_t k = 0; k < pendulums.size(); k++ )
+         {
+            batch.add( pendulums[k], benchmarkInitialAngle, 0. );
+         }
+         timer.start();
+         for( int frame = 0; frame < benchmarkFrames; frame++ )
+         {
+            batch.integrate( integrator, substeps, timestep );
+         }
+         timer.stop();
+         double batchedSeconds = timer.duration();
+
+         double difference = 0.;
+         for( size_t k = 0; k < pendulums.size(); k++ )
+         {
+            difference = max( difference, fabs( batch.getTheta( k ) - theta[k] ) );
+         }
+
+         printf( "%-18s %8d %14.2f %14.2f %14.3e\n", integratorName( integrator ), substeps,
+                 1e6 * seconds / benchmarkFrames,
+                 1e6 * batchedSeconds / benchmarkFrames,
+                 difference );
+      }
+
+      return 0;
+   }
+
+   // Keys the position of the given character to move it back and forth,
+   // which swings its pendulums, and uses the given integrator.
+   static void setupSceneCharacter( Character& character, Integrator integrator )
+   {
+      character.position.setValue( 0., Vector2D( 0., 0. ) );
+      character.position.setValue( benchmarkFrames/4, Vector2D( 200., 0. ) );
+      character.position.setValue( benchmarkFrames/2, Vector2D( 0., 100. ) );
+      character.integrator = integrator;
+   }
+
+   // Largest difference between the dynamic joint angles of two
+   // instances of the same rig.
+   static double maxAngleDifference( const Character& a, const Character& b )
+   {
+      vector<double> stateA( a.getDynamicStateSize() );
+      vector<double> stateB( b.getDynamicStateSize() );
+      if( stateA.empty() )
+      {
+         return 0.;
+      }
+      a.getDynamicState( &stateA[0] );
+      b.getDynamicState( &stateB[0] );
+
+      double difference = 0.;
+      for( size_t k = 0; k < stateA.size(); k += 2 )
+      {
+         difference = max( difference, fabs( stateA[k] - stateB[k] ) );
+      }
+      return difference;
+   }
+
+   int benchmarkScene( int nPaths, char** paths )
+   {
+      // The scene is integrated batched and one character at a time; then,
+      // with a different integrator for each character, all together and
+      // each in a scene of its own.
+      vector<Character> batched( nPaths );
+      vector<Character> scalar( nPaths );
+      vector<Character> mixed( nPaths );
+      vector< vector<Character> > alone( nPaths );
+      printf( "scene of %d characters, %d frames\n", nPaths, benchmarkFrames );
+      for( int i = 0; i < nPaths; i++ )
+      {
+         alone[i].resize( 1 );
+         if( !loadCharacter( paths[i], batched[i] ) || !loadCharacter( paths[i], scalar[i] ) ||
+             !loadCharacter( paths[i], mixed[i] ) || !loadCharacter( paths[i], alone[i][0] ) )
+         {
+            return -1;
+         }
+
+         setupSceneCharacter( batched[i], SYMPLECTIC_EULER );
+         setupSceneCharacter( scalar[i], SYMPLECTIC_EULER );
+         setupSceneCharacter( mixed[i], (Integrator) ( i % N_INTEGRATORS ) );
+         setupSceneCharacter( alone[i][0], (Integrator) ( i % N_INTEGRATORS ) );
+         printf( "   %s: %d stages, %d dynamic joints\n", paths[i], batched[i].getIntegrationStages(),
+                 (int) batched[i].getDynamicStateSize() / 2 );
+      }
+
+      const double timestep = 1. / benchmarkFramesPerSecond;
+      PendulumBatch batch;
+      double batchedSeconds = 0.;
+      double scalarSeconds = 0.;
+      for( int frame = 0; frame < benchmarkFrames; frame++ )
+      {
+         Timer timer;
+         timer.start();
+         for( int i = 0; i < nPaths; i++ )
+         {
+            batched[i].update( frame );
+         }
+         integrateBatched( batched, frame, timestep, batch );
+         timer.stop();
+         batchedSeconds += timer.duration();
+
+         timer.start();
+         for( int i = 0; i < nPaths; i++ )
+         {
+            scalar[i].update( frame );
+            scalar[i].integrate( frame, timestep );
+         }
+         timer.stop();
+         scalarSeconds += timer.duration();
+
+         for( int i = 0; i < nPaths; i++ )
+         {
+            mixed[i].update( frame );
+            alone[i][0].update( frame );
+            integrateBatched( alone[i], frame, timestep, batch );
+         }
+         integrateBatched( mixed, frame, timestep, batch );
+      }
+
+      // The first difference is rounding (see pendulum_batch.h); the
+      // second must be zero, as every pendulum takes the same arithmetic
+      // in whichever batch it is stepped.
+      double scalarDifference = 0.;
+      double aloneDifference = 0.;
+      for( int i = 0; i < nPaths; i++ )
+      {
+         scalarDifference = max( scalarDifference, maxAngleDifference( batched[i], scalar[i] ) );
+         aloneDifference = max( aloneDifference, maxAngleDifference( mixed[i], alone[i][0] ) );
+      }
+
+      printf( "%14s %14s %14s %14s\n", "us/frame", "batched", "max difference", "mixed vs alone" );
+      printf( "%14.2f %14.2f %14.3e %14.3e\n", 1e6 * scalarSeconds / benchmarkFrames,
+              1e6 * batchedSeconds / benchmarkFrames, scalarDifference, aloneDifference );
+
+      if( aloneDifference != 0. )
+      {
+         cerr << "[Animator] Batched dynamics depend on the other characters of the scene" << endl;
+         return -1;
+      }
+      return 0;
+   }
+
+   int benchmarkIK( const char* path )
+   {
+      Character character;
+      if( !loadCharacter( path, character ) )
+      {
+         return -1;
+      }
+      const size_t nJoints = character.joints.size();
+
+      // Generate the goals: a joint, a source point on it (away from its
+      // center, which its own rotation cannot move), and a reachable target.
+      vector<Joint*> goals( benchmarkIKTargets );
+      vector<Vector2D> sources( benchmarkIKTargets );
+      vector<Vector2D> targets( benchmarkIKTargets );
+      vector<double> angles( nJoints );
+      character.update( 0. );
+      srand( 462 );
+      for( int i = 0; i < benchmarkIKTargets; i++ )
+      {
+         Joint* goal = character.joints[ rand() % nJoints ];
+         goals[i] = goal;
+         sources[i] = goal->center + Vector2D( 10., 10. );
+
+         for( size_t j = 0; j < nJoints; j++ )
+         {
+            angles[j] = randomAngle( benchmarkIKPerturbation );
+         }
+         character.setPose( character.currentTransformation, angles );
+         targets[i] = goal->currentTransformation * sources[i];
+      }
+
+      printf( "%s: %d joints, %d targets\n", path, (int) nJoints, benchmarkIKTargets );
+      printf( "%-26s %10s %12s %14s %12s %10s\n", "solver", "iterations", "time (ms)", "ms/iteration", "mean error", "converged" );
+
+      for( int s = 0; s < N_IK_SOLVERS; s++ )
+      {
+         Character solver;
+         loadCharacter( path, solver );
+         solver.ikSolver = (IKSolver) s;
+         solver.ikTolerance = benchmarkIKTolerance;
+         solver.ikMaxIterations = benchmarkIKMaxIterations;
+
+         long iterations = 0;
+         int converged = 0;
+         double error = 0.;
+         double seconds = 0.;
+         for( int i = 0; i < benchmarkIKTargets; i++ )
+         {
+            Joint* goal = solver.joints[ goals[i]->index ];
+
+            solver.update( 0. );
+            Timer timer;
+            timer.start();
+            iterations += solver.solveIK( goal, sources[i], targets[i] );
+            timer.stop();
+            seconds += timer.duration();
+
+            double e = ( goal->currentTransformation * sources[i] - targets[i] ).norm();
+            error += e / benchmarkIKTargets;
+            converged += ( e <= benchmarkIKTolerance );
+         }
+
+         printf( "%-26s %10.1f %12.4f %14.5f %12.3e %9.1f%%\n", ikSolverName( (IKSolver) s ),
+                 (double) iterations / benchmarkIKTargets,
+                 1000. * seconds / benchmarkIKTargets,
+                 1000. * seconds / max( iterations, 1L ),
+                 error, 100. * converged / benchmarkIKTargets );
+      }
+
+      return 0;
+   }
+
+   int benchmarkIKBake( const char* path )
+   {
+      Character character;
+      if( !loadCharacter( path, character ) )
+      {
+         return -1;
+      }
+
+      // Drag a point on the last keyframed joint, i.e., at the end of a chain.
+      character.update( 0. );
+      Joint* goal = character.root;
+      for( size_t j = 0; j < character.joints.size(); j++ )
+      {
+         if( character.joints[j]->type == KEYFRAMED )
+         {
+            goal = character.joints[j];
+         }
+      }
+      Vector2D source = goal->center + Vector2D( 10., 10. );
+      Vector2D center = goal->currentTransformation * source;
+
+      vector<Vector2D> targets( benchmarkIKBakeFrames );
+      for( int f = 0; f < benchmarkIKBakeFrames; f++ )
+      {
+         double phi = 2. * M_PI * f / benchmarkIKBakePeriod;
+         targets[f] = center + benchmarkIKBakeRadius * Vector2D( cos( phi ), sin( phi ) );
+      }
+
+      printf( "%s: IK bake of %d frames\n", path, benchmarkIKBakeFrames );
+      printf( "%-26s %12s %14s %10s\n", "solver", "time (ms)", "us/frame", "converged" );
+
+      for( int s = 0; s < N_IK_SOLVERS; s++ )
+      {
+         Character baked;
+         loadCharacter( path, baked );
+         baked.ikSolver = (IKSolver) s;
+         baked.ikTolerance = benchmarkIKTolerance;
+         baked.ikMaxIterations = benchmarkIKMaxIterations;
+
+         Timer timer;
+         timer.start();
+         int converged = baked.bakeIK( baked.joints[ goal->index ], source, targets, 0 );
+         timer.stop();
+
+         printf( "%-26s %12.1f %14.2f %9.1f%%\n", ikSolverName( (IKSolver) s ),
+                 1000. * timer.duration(),
+                 1e6 * timer.duration() / benchmarkIKBakeFrames,
+                 100. * converged / benchmarkIKBakeFrames );
+      }
+
+      return 0;
+   }
+}
@@ -0,0 +1,53 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/*
+ * Offline benchmarks.
+ *
+ * Purpose : Measures the cost and accuracy of the numerical methods used by
+ *           the animator on the characters of a given scene, without opening
+ *           a window (see "./animator -benchmark <path to svg file>").
+ *
+ */
+
+namespace CMU462
+{
+   // Simulates every dynamic joint of the character in the given SVG file
+   // as a free pendulum (i.e., with a fixed pivot) with each integrator and
+   // several numbers of substeps per frame, and prints the wall time and the
+   // energy drift of each combination.  Returns 0 on success, or -1 if the
+   // file could not be loaded.
+   int benchmarkIntegrators( const char* path );
+
+   // Simulates the same free pendulums as benchmarkIntegrators(), repeated
+   // for many copies of the character, both one at a time and with a
+   // PendulumBatch, and prints the wall time per frame of each and the
+   // largest difference between their angles.  Returns 0 on success, or -1
+   // if the file could not be loaded.
+   int benchmarkPendulumBatch( const char* path );
+
+   // Simulates a scene with one character from each of the given SVG files,
+   // whose dynamic joints may be nested to different depths (or absent),
+   // both with integrateBatched() and with Character::integrate() on each
+   // character, and prints the wall time per frame of each and the largest
+   // difference between their angles.  Then checks that, with a different
+   // integrator for each character, every character moves exactly as it does
+   // in a scene of its own.  Returns 0 on success, or -1 if a file could not
+   // be loaded or the check failed.
+   int benchmarkScene( int nPaths, char** paths );
+
+   // Solves IK with each solver for the same random, reachable targets on
+   // the character in the given SVG file, starting from the rest pose, and
+   // prints the average number of iterations, the average wall time per
+   // solve, and the final error.  Returns 0 on success, or -1 if the file
+   // could not be loaded.
+   int benchmarkIK( const char* path );
+
+   // Bakes IK for a looping target path over many frames on the character
+   // in the given SVG file (see Character::bakeIK()), for each solver, and
+   // prints the wall time and the fraction of frames that converged.
+   // Returns 0 on success, or -1 if the file could not be loaded.
+   int benchmarkIKBake( const char* path );
+}
+
+#endif // BENCHMARK_H
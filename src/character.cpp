@@ -5,39 +5,1312 @@
  */
 
 #include "character.h"
+#include "pendulum_batch.h"
 
 #include "GL/glew.h"
 
+// Acceleration due to gravity, in pixels per second squared (i.e., assuming
+// 100 pixels per meter); gravity points down, i.e., along positive y.
+const double gravitationalAcceleration = 980.;
+
+// Number of frames between the frames solved by the coarse serial pass
+// of Character::bakeIK().
+const int ikBakeCoarseStride = 8;
+
+// Initial step size of the GRADIENT_DESCENT solver (see Character::ikGradientStep).
+const double ikInitialGradientStep = 1e-5;
+
 namespace CMU462
 {
-   bool Joint :: calculateAngleGradient( Joint* goalJoint, Vector2D p, Vector2D q )
+   const char* ikSolverName( IKSolver solver )
+   {
+      switch( solver )
+      {
+         case GRADIENT_DESCENT:          return "gradient descent";
+         case DAMPED_LEAST_SQUARES:      return "damped least squares";
+         case CYCLIC_COORDINATE_DESCENT: return "cyclic coordinate descent";
+         case FABRIK:                    return "FABRIK";
+         default:                        return "unknown";
+      }
+   }
+
+   bool Joint :: calculateAngleGradient( Joint* goalJoint, Vector2D& p, Vector2D& q )
+   {
+      ikAngleGradient = 0.;
+
+      // The goal lies below at most one of the kids.
+      bool onChain = ( this == goalJoint );
+      for( vector<Joint*>::iterator kid = kids.begin(); kid != kids.end(); kid++ )
+      {
+         if( (*kid)->calculateAngleGradient( goalJoint, p, q ) )
+         {
+            onChain = true;
+         }
+      }
+      if( !onChain )
+      {
+         return false;
+      }
+
+      // Rotating this joint by d theta moves p by ( r.y, -r.x ) d theta,
+      // where r = p - c (see Affine2D::rotation()).
+      Vector2D r = p - currentCenter;
+      if( type == KEYFRAMED )
+      {
+         ikAngleGradient = dot( p - q, Vector2D( r.y, -r.x ) );
+      }
+      else
+      {
+         // Joints above only move the center of a dynamic joint.
+         q -= r;
+         p = currentCenter;
+      }
+
+      return true;
+   }
+
+   void Character :: reachForTarget( Joint* goalJoint,
+                                     Vector2D sourcePoint,
+                                     Vector2D targetPoint,
+                                     double time )
+   {
+      if( goalJoint == NULL )
+      {
+         return;
+      }
+
+      // Optimize the pose at the given time...
+      update( time );
+      solveIK( goalJoint, sourcePoint, targetPoint );
+
+      // ...and key the angles of the joints that move the source point.
+      computeIKChain( goalJoint, goalJoint->currentTransformation * sourcePoint );
+      for( size_t k = 0; k < ikChain.size(); k++ )
+      {
+         joints[ ikChain[k] ]->setAngle( time, pose[ ikChain[k] ] );
+      }
+   }
+
+   int Character :: solveIK( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint )
+   {
+      switch( ikSolver )
+      {
+         case GRADIENT_DESCENT:          return solveIKGradientDescent( goalJoint, sourcePoint, targetPoint );
+         case CYCLIC_COORDINATE_DESCENT: return solveIKCyclicCoordinateDescent( goalJoint, sourcePoint, targetPoint );
+         case FABRIK:                    return solveIKFABRIK( goalJoint, sourcePoint, targetPoint );
+         default:                        return solveIK( vector<IKConstraint>( 1, IKConstraint( goalJoint, sourcePoint, targetPoint ) ) );
+      }
+   }
+
+   int Character :: solveIKGradientDescent( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint )
+   {
+      const size_t nJoints = joints.size();
+
+      Vector2D p = goalJoint->currentTransformation * sourcePoint;
+      double energy = .5 * ( p - targetPoint ).norm2();
+
+      int iteration = 0;
+      for( ; iteration < ikMaxIterations && energy > .5*ikTolerance*ikTolerance; iteration++ )
+      {
+         Vector2D q = targetPoint;
+         root->calculateAngleGradient( goalJoint, p, q );
+
+         // Take a step, and keep it (growing the next one) if it reduces the
+         // energy; otherwise, retract it and try again with a shorter step.
+         double energy1 = energy;
+         for( int attempt = 0; attempt < 16 && energy1 >= energy; attempt++ )
+         {
+            for( size_t j = 0; j < nJoints; j++ )
+            {
+               pose[j] -= ikGradientStep * joints[j]->ikAngleGradient;
+            }
+            updateJoints();
+
+            p = goalJoint->currentTransformation * sourcePoint;
+            energy1 = .5 * ( p - targetPoint ).norm2();
+            if( energy1 >= energy )
+            {
+               for( size_t j = 0; j < nJoints; j++ )
+               {
+                  pose[j] += ikGradientStep * joints[j]->ikAngleGradient;
+               }
+               ikGradientStep *= .5;
+            }
+         }
+
+         if( energy1 >= energy )
+         {
+            // (No step reduces the energy; we are at a local minimum.)
+            updateJoints();
+            break;
+         }
+
+         energy = energy1;
+         ikGradientStep *= 1.5;
+      }
+
+      return iteration;
+   }
+
+   // Solves A x = b in place (overwriting b with x) for the symmetric positive
+   // definite n x n matrix A, of which only the lower triangle (row major)
+   // is used, and which is overwritten by its Cholesky factor.
+   static void solveCholesky( double* A, double* b, int n )
+   {
+      for( int j = 0; j < n; j++ )
+      {
+         double d = A[ j*n + j ];
+         for( int k = 0; k < j; k++ )
+         {
+            d -= A[ j*n + k ] * A[ j*n + k ];
+         }
+         d = sqrt( d );
+         A[ j*n + j ] = d;
+
+         for( int i = j+1; i < n; i++ )
+         {
+            double s = A[ i*n + j ];
+            for( int k = 0; k < j; k++ )
+            {
+               s -= A[ i*n + k ] * A[ j*n + k ];
+            }
+            A[ i*n + j ] = s / d;
+         }
+      }
+
+      // L y = b, then L^T x = y.
+      for( int i = 0; i < n; i++ )
+      {
+         for( int k = 0; k < i; k++ )
+         {
+            b[i] -= A[ i*n + k ] * b[k];
+         }
+         b[i] /= A[ i*n + i ];
+      }
+      for( int i = n-1; i >= 0; i-- )
+      {
+         for( int k = i+1; k < n; k++ )
+         {
+            b[i] -= A[ k*n + i ] * b[k];
+         }
+         b[i] /= A[ i*n + i ];
+      }
+   }
+
+   int Character :: solveIK( const vector<IKConstraint>& constraints )
+   {
+      if( constraints.size() == 1 )
+      {
+         const IKConstraint& c( constraints[0] );
+         switch( ikSolver )
+         {
+            case CYCLIC_COORDINATE_DESCENT: return solveIKCyclicCoordinateDescent( c.joint, c.sourcePoint, c.targetPoint );
+            case FABRIK:                    return solveIKFABRIK( c.joint, c.sourcePoint, c.targetPoint );
+            default:                        break;
+         }
+      }
+
+      if( ikSolver == GRADIENT_DESCENT )
+      {
+         return solveIKGradientDescent( constraints );
+      }
+      return solveIKDampedLeastSquares( constraints );
+   }
+
+   void Character :: reachForTargets( const vector<IKConstraint>& constraints, double time )
+   {
+      if( constraints.empty() )
+      {
+         return;
+      }
+
+      update( time );
+      solveIK( constraints );
+      keyIKSolution( constraints, pose, time );
+   }
+
+   void Character :: keyIKSolution( const vector<IKConstraint>& constraints, const vector<double>& angles, double time )
+   {
+      // Key the angles of the joints that move any source point.
+      const size_t nJoints = joints.size();
+      ikMoved.assign( nJoints, 0 );
+      for( size_t c = 0; c < constraints.size(); c++ )
+      {
+         for( int j = constraints[c].joint->index; j >= 0 && !ikMoved[j]; j = jointParents[j] )
+         {
+            ikMoved[j] = 1;
+         }
+      }
+      for( size_t j = 0; j < nJoints; j++ )
+      {
+         if( ikMoved[j] && !jointIsDynamic[j] )
+         {
+            joints[j]->setAngle( time, angles[j] );
+         }
+      }
+   }
+
+   int Character :: bakeIK( Joint* goalJoint, Vector2D sourcePoint, Spline<Vector2D>& targets, int firstFrame, int lastFrame )
+   {
+      const int nFrames = lastFrame - firstFrame + 1;
+      if( nFrames <= 0 )
+      {
+         return 0;
+      }
+
+      vector<double> times( nFrames );
+      for( int f = 0; f < nFrames; f++ )
+      {
+         times[f] = firstFrame + f;
+      }
+      vector<Vector2D> points( nFrames );
+      targets.evaluateMany( &times[0], &points[0], nFrames );
+
+      return bakeIK( goalJoint, sourcePoint, points, firstFrame );
+   }
+
+   int Character :: bakeIK( Joint* goalJoint, Vector2D sourcePoint, const vector<Vector2D>& targets, int firstFrame )
+   {
+      const int nFrames = targets.size();
+      const size_t nJoints = joints.size();
+      if( goalJoint == NULL || nFrames == 0 )
+      {
+         return 0;
+      }
+
+      // The starting pose of every frame, as reachForTarget() would see it;
+      // the rows are overwritten by the solutions.
+      vector<double> angles( nFrames*nJoints );
+      vector<Affine2D> transformations( nFrames );
+      for( int f = 0; f < nFrames; f++ )
+      {
+         update( firstFrame + f );
+         copy( pose.begin(), pose.end(), &angles[ f*nJoints ] );
+         transformations[f] = currentTransformation;
+      }
+
+      // The joints to solve for (and key).
+      computeIKChain( goalJoint, goalJoint->currentTransformation * sourcePoint );
+      const vector<int> chain( ikChain );
+
+      // Coarse pass: every ikBakeCoarseStride-th frame and the last one, in
+      // order, each starting from the solution of the previous one.
+      int converged = 0;
+      vector<double> start( nJoints );
+      for( int f = 0, previous = -1; f < nFrames; previous = f, f = ( f == nFrames-1 ) ? nFrames : min( f + ikBakeCoarseStride, nFrames-1 ) )
+      {
+         double* a = &angles[ f*nJoints ];
+         copy( a, a + nJoints, start.begin() );
+         for( size_t k = 0; k < chain.size() && previous >= 0; k++ )
+         {
+            start[ chain[k] ] = angles[ previous*nJoints + chain[k] ];
+         }
+
+         setPose( transformations[f], start );
+         solveIK( goalJoint, sourcePoint, targets[f] );
+         copy( pose.begin(), pose.end(), a );
+         converged += ( ( goalJoint->currentTransformation * sourcePoint - targets[f] ).norm() <= ikTolerance );
+      }
+
+      // Fine pass: the frames in between, each on a private instance of the rig.
+      vector<double> dynamicState( getDynamicStateSize() );
+      if( !dynamicState.empty() )
+      {
+         getDynamicState( &dynamicState[0] );
+      }
+
+      #pragma omp parallel reduction( + : converged ) firstprivate( start )
+      {
+         // Each thread borrows an instance of the rig from ikBakeSolvers (or
+         // makes one), and returns it once done, for the next bake to reuse.
+         unique_ptr<Character> instance;
+         #pragma omp critical( ikBakeSolvers )
+         if( !ikBakeSolvers.empty() )
+         {
+            instance = move( ikBakeSolvers.back() );
+            ikBakeSolvers.pop_back();
+         }
+         if( !instance )
+         {
+            instance.reset( new Character() );
+         }
+         Character& solver( *instance );
+
+         if( solver.getRig() != rig )
+         {
+            solver.instantiate( rig );
+         }
+         solver.ikSolver = ikSolver;
+         solver.ikMaxIterations = ikMaxIterations;
+         solver.ikTolerance = ikTolerance;
+         solver.ikDamping = ikDamping;
+         solver.ikGradientStep = ikInitialGradientStep;
+         if( !dynamicState.empty() )
+         {
+            solver.setDynamicState( &dynamicState[0] );
+         }
+         Joint* goal = solver.joints[ goalJoint->index ];
+
+         #pragma omp for schedule( dynamic, 16 )
+         for( int f = 0; f < nFrames; f++ )
+         {
+            int f0 = f - f % ikBakeCoarseStride;
+            int f1 = min( f0 + ikBakeCoarseStride, nFrames-1 );
+            if( f == f0 || f == nFrames-1 )
+            {
+               continue;
+            }
+
+            // Interpolate the coarse solutions on either side.
+            double u = (double) ( f - f0 ) / ( f1 - f0 );
+            double* a = &angles[ f*nJoints ];
+            copy( a, a + nJoints, start.begin() );
+            for( size_t k = 0; k < chain.size(); k++ )
+            {
+               int j = chain[k];
+               start[j] = (1.-u)*angles[ f0*nJoints + j ] + u*angles[ f1*nJoints + j ];
+            }
+
+            solver.setPose( transformations[f], start );
+            solver.solveIK( goal, sourcePoint, targets[f] );
+            copy( solver.pose.begin(), solver.pose.end(), a );
+            converged += ( ( goal->currentTransformation * sourcePoint - targets[f] ).norm() <= ikTolerance );
+         }
+
+         #pragma omp critical( ikBakeSolvers )
+         ikBakeSolvers.push_back( move( instance ) );
+      }
+
+      // Key the solutions (serially, as the splines are shared), one joint at a time.
+      vector<double> times( nFrames );
+      vector<double> values( nFrames );
+      for( int f = 0; f < nFrames; f++ )
+      {
+         times[f] = firstFrame + f;
+      }
+      for( size_t k = 0; k < chain.size(); k++ )
+      {
+         for( int f = 0; f < nFrames; f++ )
+         {
+            values[f] = angles[ f*nJoints + chain[k] ];
+         }
+         joints[ chain[k] ]->setAngles( &times[0], &values[0], nFrames );
+      }
+
+      return converged;
+   }
+
+   bool Character :: ikConverged( const vector<IKConstraint>& constraints ) const
+   {
+      for( size_t c = 0; c < constraints.size(); c++ )
+      {
+         const IKConstraint& k( constraints[c] );
+         if( ( k.joint->currentTransformation * k.sourcePoint - k.targetPoint ).norm() > ikTolerance )
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   double Character :: computeIKGradient( const vector<IKConstraint>& constraints )
+   {
+      const size_t nJoints = joints.size();
+
+      // The gradient for joint j is a sum over the constraints below it of
+      //    w e . ( r.y, -r.x ) = w ( e.x l.y - e.y l.x ) - w ( e.x c.y - e.y c.x ),
+      // where e = p - q is the residual, l the point that j moves rigidly
+      // (see computeIKChain()), c its center, and r = l - c.  Hence it only
+      // takes the sums over the subtree of w e and of w ( e.x l.y - e.y l.x ),
+      // which are accumulated from the leaves up (as children come after
+      // their parents) in a single pass for all constraints.
+      ikSubtreeResiduals.assign( nJoints, Vector2D( 0., 0. ) );
+      ikSubtreeMoments.assign( nJoints, 0. );
+
+      double energy = 0.;
+      for( size_t c = 0; c < constraints.size(); c++ )
+      {
+         const IKConstraint& k( constraints[c] );
+         Vector2D p = k.joint->currentTransformation * k.sourcePoint;
+         Vector2D e = p - k.targetPoint;
+
+         ikSubtreeResiduals[ k.joint->index ] += k.weight * e;
+         ikSubtreeMoments[ k.joint->index ] += k.weight * ( e.x*p.y - e.y*p.x );
+         energy += .5 * k.weight * e.norm2();
+      }
+
+      for( int j = nJoints-1; j >= 0; j-- )
+      {
+         const Vector2D& E( ikSubtreeResiduals[j] );
+         const Vector2D& c( joints[j]->currentCenter );
+
+         if( jointIsDynamic[j] )
+         {
+            // Joints above only move the center of a dynamic joint.
+            joints[j]->ikAngleGradient = 0.;
+            ikSubtreeMoments[j] = E.x*c.y - E.y*c.x;
+         }
+         else
+         {
+            joints[j]->ikAngleGradient = ikSubtreeMoments[j] - ( E.x*c.y - E.y*c.x );
+         }
+
+         int parent = jointParents[j];
+         if( parent >= 0 )
+         {
+            ikSubtreeResiduals[ parent ] += E;
+            ikSubtreeMoments[ parent ] += ikSubtreeMoments[j];
+         }
+      }
+
+      return energy;
+   }
+
+   int Character :: solveIKGradientDescent( const vector<IKConstraint>& constraints )
+   {
+      const size_t nJoints = joints.size();
+
+      double energy = computeIKGradient( constraints );
+
+      int iteration = 0;
+      for( ; iteration < ikMaxIterations && !ikConverged( constraints ); iteration++ )
+      {
+         // (See the single-target version.)
+         double energy1 = energy;
+         for( int attempt = 0; attempt < 16 && energy1 >= energy; attempt++ )
+         {
+            for( size_t j = 0; j < nJoints; j++ )
+            {
+               pose[j] -= ikGradientStep * joints[j]->ikAngleGradient;
+            }
+            updateJoints();
+
+            energy1 = 0.;
+            for( size_t c = 0; c < constraints.size(); c++ )
+            {
+               const IKConstraint& k( constraints[c] );
+               energy1 += .5 * k.weight * ( k.joint->currentTransformation * k.sourcePoint - k.targetPoint ).norm2();
+            }
+
+            if( energy1 >= energy )
+            {
+               for( size_t j = 0; j < nJoints; j++ )
+               {
+                  pose[j] += ikGradientStep * joints[j]->ikAngleGradient;
+               }
+               ikGradientStep *= .5;
+            }
+         }
+
+         if( energy1 >= energy )
+         {
+            updateJoints();
+            break;
+         }
+
+         ikGradientStep *= 1.5;
+         energy = computeIKGradient( constraints );
+      }
+
+      return iteration;
+   }
+
+   int Character :: solveIKDampedLeastSquares( const vector<IKConstraint>& constraints )
+   {
+      const size_t nJoints = joints.size();
+      const int m = 2 * constraints.size();
+      const double lambda2 = ikDamping * ikDamping;
+
+      int iteration = 0;
+      for( ; iteration < ikMaxIterations && !ikConverged( constraints ); iteration++ )
+      {
+         // Build the columns of the (weighted) Jacobian of all source points,
+         // i.e., the derivatives of the stacked points with respect to each
+         // angle, in a single pass from the leaves up, carrying along the
+         // point that each joint moves for every constraint below it.
+         // (Which constraints lie below each joint, and the points it moves
+         // for them, are tracked per joint, as chains may share joints.)
+         ikColumns.assign( nJoints*m, 0. );
+         ikConstraintLevers.resize( nJoints*m/2 );
+         ikBelow.assign( nJoints*m/2, 0 );
+         ikMoved.assign( nJoints, 0 );
+         ikResidual.resize( m );
+         for( int c = 0; c < m/2; c++ )
+         {
+            const IKConstraint& k( constraints[c] );
+            int j = k.joint->index;
+            Vector2D p = k.joint->currentTransformation * k.sourcePoint;
+            Vector2D e = sqrt( k.weight ) * ( k.targetPoint - p );
+
+            ikResidual[ 2*c+0 ] = e.x;
+            ikResidual[ 2*c+1 ] = e.y;
+            ikConstraintLevers[ j*m/2 + c ] = p;
+            ikBelow[ j*m/2 + c ] = 1;
+            ikMoved[j] = 1;
+         }
+
+         for( int j = nJoints-1; j >= 0; j-- )
+         {
+            if( !ikMoved[j] )
+            {
+               continue;
+            }
+
+            const Vector2D& center( joints[j]->currentCenter );
+            int parent = jointParents[j];
+            for( int c = 0; c < m/2; c++ )
+            {
+               if( !ikBelow[ j*m/2 + c ] )
+               {
+                  continue;
+               }
+
+               Vector2D& l( ikConstraintLevers[ j*m/2 + c ] );
+               if( jointIsDynamic[j] )
+               {
+                  l = center;
+               }
+               else
+               {
+                  Vector2D r = sqrt( constraints[c].weight ) * ( l - center );
+                  ikColumns[ j*m + 2*c+0 ] =  r.y;
+                  ikColumns[ j*m + 2*c+1 ] = -r.x;
+               }
+
+               if( parent >= 0 )
+               {
+                  ikBelow[ parent*m/2 + c ] = 1;
+                  ikConstraintLevers[ parent*m/2 + c ] = l;
+               }
+            }
+            if( parent >= 0 )
+            {
+               ikMoved[ parent ] = 1;
+            }
+         }
+
+         // Solve ( J J^T + lambda^2 I ) y = e, which is only 2x2 per
+         // constraint, by Cholesky factorization; the step is J^T y.
+         ikNormalMatrix.assign( m*m, 0. );
+         for( size_t j = 0; j < nJoints; j++ )
+         {
+            joints[j]->ikAngleGradient = 0.;
+            if( !ikMoved[j] || jointIsDynamic[j] )
+            {
+               continue;
+            }
+
+            const double* column = &ikColumns[ j*m ];
+            for( int a = 0; a < m; a++ )
+            {
+               for( int b = 0; b <= a; b++ )
+               {
+                  ikNormalMatrix[ a*m + b ] += column[a] * column[b];
+               }
+
+               // (for display by the debug widgets)
+               joints[j]->ikAngleGradient -= column[a] * ikResidual[a];
+            }
+         }
+         for( int a = 0; a < m; a++ )
+         {
+            ikNormalMatrix[ a*m + a ] += lambda2;
+         }
+         solveCholesky( &ikNormalMatrix[0], &ikResidual[0], m );
+
+         for( size_t j = 0; j < nJoints; j++ )
+         {
+            if( !ikMoved[j] || jointIsDynamic[j] )
+            {
+               continue;
+            }
+
+            const double* column = &ikColumns[ j*m ];
+            for( int a = 0; a < m; a++ )
+            {
+               pose[j] += column[a] * ikResidual[a];
+            }
+         }
+         updateJoints();
+      }
+
+      return iteration;
+   }
+
+   // Returns the angle by which Affine2D::rotation() must
+   // rotate the vector a to give it the direction of b.
+   static double rotationBetween( Vector2D a, Vector2D b )
+   {
+      return -atan2( cross( a, b ), dot( a, b ) );
+   }
+
+   int Character :: solveIKCyclicCoordinateDescent( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint )
+   {
+      int iteration = 0;
+      for( ; iteration < ikMaxIterations; iteration++ )
+      {
+         Vector2D p = goalJoint->currentTransformation * sourcePoint;
+         if( ( p - targetPoint ).norm() <= ikTolerance )
+         {
+            break;
+         }
+
+         // Visit the joints from the goal up to the root, turning each one so
+         // that the point it moves points at the target.  Rotating a joint does
+         // not move the centers of those above it, so p can simply be rotated
+         // along rather than recomputing the whole pose.  (Dynamic joints are
+         // skipped as in Joint::calculateAngleGradient().)
+         Vector2D q = targetPoint;
+         for( int j = goalJoint->index; j >= 0; j = jointParents[j] )
+         {
+            Vector2D c = joints[j]->currentCenter;
+            if( jointIsDynamic[j] )
+            {
+               q -= p - c;
+               p = c;
+               continue;
+            }
+
+            Vector2D a = p - c;
+            Vector2D b = q - c;
+            if( a.norm2() == 0. || b.norm2() == 0. )
+            {
+               continue;
+            }
+
+            double theta = rotationBetween( a, b );
+            pose[j] += theta;
+            p = c + Affine2D::rotation( theta ).transformDirection( a );
+         }
+         updateJoints();
+      }
+
+      return iteration;
+   }
+
+   int Character :: solveIKFABRIK( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint )
+   {
+      // The chain is described by the center c[k] of each keyframed joint on
+      // it (from the goal up), the point l[k] that this joint moves rigidly
+      // (see computeIKChain()), and the offset o[k] = c[k-1] - l[k] from that
+      // point to the center below, which is fixed (nonzero only if dynamic
+      // joints, whose orientation is fixed, lie in between).  FABRIK alternates
+      // between placing the bottom of the chain at the target, and the top at
+      // its fixed center, each time preserving the lengths |l[k] - c[k]|.
+      vector<Vector2D>& c( ikCenters );
+      vector<Vector2D>& l( ikLevers );
+
+      int iteration = 0;
+      for( ; iteration < ikMaxIterations; iteration++ )
+      {
+         Vector2D p = goalJoint->currentTransformation * sourcePoint;
+         if( ( p - targetPoint ).norm() <= ikTolerance )
+         {
+            break;
+         }
+
+         computeIKChain( goalJoint, p );
+         const int m = ikChain.size();
+         if( m == 0 )
+         {
+            break;
+         }
+
+         ikFabrikCenters = c;
+         ikFabrikLevers = l;
+         vector<Vector2D>& cNew( ikFabrikCenters );
+         vector<Vector2D>& lNew( ikFabrikLevers );
+
+         // Backward: the bottom reaches the target (shifted as
+         // in computeIKChain() if the goal is below dynamic joints).
+         lNew[0] = targetPoint - ( p - l[0] );
+         for( int k = 0; k < m; k++ )
+         {
+            if( k > 0 )
+            {
+               lNew[k] = cNew[k-1] - ( c[k-1] - l[k] );
+            }
+            Vector2D d = cNew[k] - lNew[k];
+            if( d.norm2() > 0. )
+            {
+               cNew[k] = lNew[k] + ( l[k] - c[k] ).norm() * d.unit();
+            }
+         }
+
+         // Forward: the top returns to its (fixed) center.
+         for( int k = m-1; k >= 0; k-- )
+         {
+            cNew[k] = k == m-1 ? c[k] : lNew[k+1] + ( c[k] - l[k+1] );
+            Vector2D d = lNew[k] - cNew[k];
+            if( d.norm2() > 0. )
+            {
+               lNew[k] = cNew[k] + ( l[k] - c[k] ).norm() * d.unit();
+            }
+         }
+
+         // Turn each joint (from the top down) by the change in direction of
+         // its lever, less that of its parent, which already turned it.
+         double parentTurn = 0.;
+         for( int k = m-1; k >= 0; k-- )
+         {
+            int j = ikChain[k];
+            bool attached = ( k < m-1 && jointParents[j] == ikChain[k+1] );
+            double inherited = attached ? parentTurn : 0.;
+
+            Vector2D a = l[k] - c[k];
+            Vector2D b = lNew[k] - cNew[k];
+            double turn = ( a.norm2() > 0. && b.norm2() > 0. ) ? rotationBetween( a, b ) : inherited;
+
+            pose[j] += turn - inherited;
+            parentTurn = turn;
+         }
+         updateJoints();
+      }
+
+      return iteration;
+   }
+
+   void Character :: computeIKChain( Joint* goalJoint, Vector2D p )
+   {
+      ikChain.clear();
+      ikCenters.clear();
+      ikLevers.clear();
+      ikJacobian.clear();
+
+      // (See Joint::calculateAngleGradient().)
+      for( int j = goalJoint->index; j >= 0; j = jointParents[j] )
+      {
+         Vector2D c = joints[j]->currentCenter;
+         if( jointIsDynamic[j] )
+         {
+            p = c;
+         }
+         else
+         {
+            Vector2D r = p - c;
+            ikChain.push_back( j );
+            ikCenters.push_back( c );
+            ikLevers.push_back( p );
+            ikJacobian.push_back( Vector2D( r.y, -r.x ) );
+         }
+      }
+   }
+
+   void Joint :: integrate( double timestep, Vector2D cumulativeAcceleration,
+                            Integrator integrator, int substeps )
+   {
+      if( type != DYNAMIC )
+      {
+         return;
+      }
+
+      integratePendulum( getPendulum( cumulativeAcceleration ), integrator, substeps, timestep, theta, omega );
+   }
+
+   Pendulum Joint :: getPendulum( Vector2D cumulativeAcceleration ) const
+   {
+      const MassProperties& p( getMassProperties() );
+
+      Pendulum pendulum;
+      if( p.mass > 0. && p.inertia > 0. )
+      {
+         pendulum.massOverInertia = p.mass / p.inertia;
+         pendulum.centerOfMass = p.centroid - center;
+      }
+
+      // In the (accelerating) frame of the center, the
+      // acceleration of the center opposes gravity.
+      pendulum.gravity = Vector2D( 0., gravitationalAcceleration ) - cumulativeAcceleration;
+      return pendulum;
+   }
+
+   void Character :: integrate( double time, double timestep )
+   {
+      beginIntegration();
+
+      // Visit each joint after its parent, stepping every
+      // pendulum as soon as the motion of its pivot is known.
+      for( size_t j = 0; j < joints.size(); j++ )
+      {
+         computeJointMotion( j, time );
+
+         if( jointIsDynamic[j] )
+         {
+            Joint* joint = joints[j];
+            double theta = joint->getTheta();
+            double omega = joint->getOmega();
+            integratePendulum( joint->getPendulum( jointAccelerations[j] ), integrator, substeps, timestep, theta, omega );
+            finishPendulumStep( j, theta, omega, timestep );
+         }
+      }
+   }
+
+   void Character :: beginIntegration( void )
+   {
+      const size_t nJoints = joints.size();
+
+      previousDynamicAngles.resize( dynamicJoints.size() );
+      for( size_t k = 0; k < dynamicJoints.size(); k++ )
+      {
+         previousDynamicAngles[k] = joints[ dynamicJoints[k] ]->getTheta();
+      }
+
+      jointAngularVelocities.resize( nJoints );
+      jointAngularAccelerations.resize( nJoints );
+      jointAccelerations.resize( nJoints );
+      jointBatchIndices.resize( nJoints );
+   }
+
+   void Character :: gatherPendulums( int stage, double time, PendulumBatch& batch )
    {
-      // TODO IMPLEMENT ME (TASK 2A)
-      return false;
+      if( stage >= (int) integrationStages.size() )
+      {
+         return;
+      }
+
+      const vector<int>& stageJoints( integrationStages[ stage ] );
+      for( size_t k = 0; k < stageJoints.size(); k++ )
+      {
+         int j = stageJoints[k];
+         computeJointMotion( j, time );
+
+         if( jointIsDynamic[j] )
+         {
+            Joint* joint = joints[j];
+            jointBatchIndices[j] = batch.add( joint->getPendulum( jointAccelerations[j] ), joint->theta, joint->omega );
+         }
+      }
    }
 
-   void Character :: reachForTarget( Joint* goalJoint,
-                                     Vector2D sourcePoint,
-                                     Vector2D targetPoint,
-                                     double time )
+   void Character :: scatterPendulums( int stage, const PendulumBatch& batch, double timestep )
+   {
+      if( stage >= (int) integrationStages.size() )
+      {
+         return;
+      }
+
+      const vector<int>& stageJoints( integrationStages[ stage ] );
+      for( size_t k = 0; k < stageJoints.size(); k++ )
+      {
+         int j = stageJoints[k];
+         if( jointIsDynamic[j] )
+         {
+            size_t i = jointBatchIndices[j];
+            finishPendulumStep( j, batch.getTheta( i ), batch.getOmega( i ), timestep );
+         }
+      }
+   }
+
+   // The center of the root moves with the character; the center of any
+   // other joint is a point rigidly attached to its parent's frame, which
+   // rotates with angle phi, so that
+   //    a = a_parent + phi'' ( r.y, -r.x ) - phi'^2 r
+   // where r is its offset from the parent's center (see Affine2D::rotation()).
+   void Character :: computeJointMotion( int j, double time )
+   {
+      const double perSecond  = 1. / secondsPerFrame;
+      const double perSecond2 = perSecond * perSecond;
+
+      Joint* joint = joints[j];
+      const int parent = jointParents[j];
+
+      double parentVelocity = 0.;
+      double parentAcceleration = 0.;
+      Vector2D a;
+      if( parent < 0 )
+      {
+         a = position.evaluate<2>( time ) * perSecond2;
+      }
+      else
+      {
+         parentVelocity = jointAngularVelocities[ parent ];
+         parentAcceleration = jointAngularAccelerations[ parent ];
+
+         Vector2D r = joint->currentCenter - joints[ parent ]->currentCenter;
+         a = jointAccelerations[ parent ] +
+             parentAcceleration * Vector2D( r.y, -r.x ) -
+             ( parentVelocity * parentVelocity ) * r;
+      }
+      jointAccelerations[j] = a;
+
+      // (The angle of a pendulum is absolute; see updateJoints().)
+      if( !jointIsDynamic[j] )
+      {
+         Spline<double>::Sample angle = joint->getAngleSpline().evaluateAll( time );
+         jointAngularVelocities[j] = parentVelocity + angle.d1 * perSecond;
+         jointAngularAccelerations[j] = parentAcceleration + angle.d2 * perSecond2;
+      }
+   }
+
+   void Character :: finishPendulumStep( int j, double theta, double omega, double timestep )
    {
-      // TODO IMPLEMENT ME (TASK 2B)
+      Joint* joint = joints[j];
+
+      jointAngularVelocities[j] = omega;
+      jointAngularAccelerations[j] = ( omega - joint->omega ) / timestep;
+      joint->theta = theta;
+      joint->omega = omega;
    }
 
-   void Joint :: integrate( double time, double timestep, Vector2D cumulativeAcceleration )
+   void Character :: resetDynamics( void )
    {
-      // TODO IMPLEMENT ME (TASK 3A)
+      for( size_t j = 0; j < joints.size(); j++ )
+      {
+         joints[j]->resetDynamics();
+      }
+      previousDynamicAngles.clear();
    }
 
-   void Character :: integrate( double time, double timestep )
+   void Character :: getDynamicState( double* state ) const
+   {
+      for( size_t k = 0; k < dynamicJoints.size(); k++ )
+      {
+         const Joint* joint = joints[ dynamicJoints[k] ];
+         state[ 2*k+0 ] = joint->theta;
+         state[ 2*k+1 ] = joint->omega;
+      }
+   }
+
+   void Character :: setDynamicState( const double* state )
+   {
+      for( size_t k = 0; k < dynamicJoints.size(); k++ )
+      {
+         Joint* joint = joints[ dynamicJoints[k] ];
+         joint->theta = state[ 2*k+0 ];
+         joint->omega = state[ 2*k+1 ];
+      }
+      previousDynamicAngles.clear();
+   }
+
+   Character :: Character( void )
+   : integrator( SYMPLECTIC_EULER ),
+     substeps( 1 ),
+     secondsPerFrame( 1. / 60. ),
+     ikSolver( DAMPED_LEAST_SQUARES ),
+     ikMaxIterations( 20 ),
+     ikTolerance( .25 ),
+     ikDamping( 10. ),
+     bakeInterpolation( false ),
+     bakedAngleError( 0. ),
+     bakedPositionError( 0. ),
+     ikGradientStep( ikInitialGradientStep ),
+     bakedFrames( 0 ),
+     updatedTime( 0. ),
+     updatedPoseValid( false )
+   {}
+
+   void Character :: update( double time, double dynamicsBlend )
+   {
+      const size_t nJoints = joints.size();
+      pose.resize( nJoints );
+
+      // If "pose" still holds the angles evaluated by the last call, at the
+      // same time, only the splines modified since need to be evaluated again.
+      bool interpolated = false;
+      getSplineVersions( splineVersions );
+      if( updatedPoseValid && time == updatedTime && updatedVersions.size() == nJoints+1 )
+      {
+         for( size_t j = 0; j < nJoints; j++ )
+         {
+            if( !jointIsDynamic[j] && splineVersions[j] != updatedVersions[j] )
+            {
+               pose[j] = joints[j]->getAngleSpline().evaluate( time );
+            }
+         }
+         if( splineVersions[ nJoints ] != updatedVersions[ nJoints ] )
+         {
+            currentTransformation = Affine2D::translation( position.evaluate( time ) );
+         }
+      }
+      else if( bakedFrames > 0 && 0. <= time && time <= bakedFrames-1 &&
+               ( floor( time ) == time || bakeInterpolation ) && isBaked( bakedFrames ) )
+      {
+         // Within the range of a current bake, read (or interpolate) the tables.
+         double frame = floor( time );
+         bool integerFrame = ( frame == time );
+
+         size_t f = (size_t) frame;
+         const double* a0 = &bakedAngles[ f*nJoints ];
+         if( integerFrame )
+         {
+            copy( a0, a0 + nJoints, pose.begin() );
+            currentTransformation = Affine2D::translation( bakedPositions[f] );
+         }
+         else
+         {
+            double u = time - frame;
+            const double* a1 = a0 + nJoints;
+            for( size_t j = 0; j < nJoints; j++ )
+            {
+               pose[j] = (1.-u)*a0[j] + u*a1[j];
+            }
+            currentTransformation = Affine2D::translation( (1.-u)*bakedPositions[f] + u*bakedPositions[f+1] );
+            interpolated = true;
+         }
+      }
+      else
+      {
+         currentTransformation = Affine2D::translation( position.evaluate( time ) );
+
+         // Evaluate all keyframed joint angles in one pass.
+         angleBank.evaluate( time, &pose[0] );
+      }
+
+      updateJoints( dynamicsBlend );
+
+      // (Interpolated baked angles differ slightly from the splines, so
+      // they cannot be mixed with angles evaluated from the splines.)
+      updatedPoseValid = !interpolated;
+      updatedTime = time;
+      updatedVersions.swap( splineVersions );
+   }
+
+   void Character :: setPose( const Affine2D& transformation, const vector<double>& angles )
+   {
+      currentTransformation = transformation;
+      if( &angles != &pose )
+      {
+         pose.assign( angles.begin(), angles.end() );
+      }
+      pose.resize( joints.size() );
+
+      updateJoints();
+   }
+
+   // Returns true iff the two transformations are identical.
+   static bool sameTransformation( const Affine2D& A, const Affine2D& B )
+   {
+      for( int i = 0; i < 2; i++ )
+      for( int j = 0; j < 3; j++ )
+      {
+         if( A(i,j) != B(i,j) )
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   void Character :: updateJoints( double dynamicsBlend )
+   {
+      const size_t nJoints = joints.size();
+
+      // The pose may now differ from the splines (see update()).
+      updatedPoseValid = false;
+
+      // Dynamic joints take their current simulated angle, or an
+      // interpolation between their previous and current angle.
+      bool blend = ( dynamicsBlend < 1. && previousDynamicAngles.size() == dynamicJoints.size() );
+      for( size_t k = 0; k < dynamicJoints.size(); k++ )
+      {
+         double theta = joints[ dynamicJoints[k] ]->getTheta();
+         if( blend )
+         {
+            theta = (1.-dynamicsBlend)*previousDynamicAngles[k] + dynamicsBlend*theta;
+         }
+         pose[ dynamicJoints[k] ] = theta;
+      }
+
+      // Only the subtrees below joints whose angle changed since the last
+      // call need to be recomputed (all of them, if the character moved).
+      bool moved = ( transformedPose.size() != nJoints ||
+                     !sameTransformation( currentTransformation, transformedTransformation ) );
+      transformedPose.resize( nJoints );
+      transformedTransformation = currentTransformation;
+      jointChanged.resize( nJoints );
+
+      for( size_t j = 0; j < nJoints; j++ )
+      {
+         const int parent = jointParents[j];
+         jointChanged[j] = ( parent < 0 ? moved : jointChanged[ parent ] ) || pose[j] != transformedPose[j];
+         if( !jointChanged[j] )
+         {
+            continue;
+         }
+         transformedPose[j] = pose[j];
+
+         const Affine2D& parentTransformation =
+            parent < 0 ? currentTransformation : jointTransformations[ parent ];
+
+         double alpha = pose[j];
+         if( jointIsDynamic[j] )
+         {
+            // A pendulum should hang straight down; its angle should
+            // not be affected by the rotation of any joints above it.
+            alpha -= parentTransformation.getRotation();
+         }
+
+         jointTransformations[j] = parentTransformation * Affine2D::rotation( alpha, jointCenters[j] );
+
+         // Copy the results to the joint, which are read when drawing and editing.
+         Joint* joint = joints[j];
+         joint->currentParentTransformation = parentTransformation;
+         joint->currentTransformation = jointTransformations[j];
+         joint->currentCenter = jointTransformations[j] * jointCenters[j];
+      }
+   }
+
+   void Character :: compileJoints( void )
+   {
+      const size_t nJoints = joints.size();
+
+      jointParents.assign( nJoints, -1 );
+      jointCenters.resize( nJoints );
+      jointIsDynamic.resize( nJoints );
+      jointTransformations.resize( nJoints );
+      dynamicJoints.clear();
+      previousDynamicAngles.clear();
+      pose.assign( nJoints, 0. );
+      transformedPose.clear();
+      updatedPoseValid = false;
+
+      // The number of dynamic ancestors of every joint.
+      vector<int> stages( nJoints, 0 );
+      int lastStage = -1;
+
+      for( size_t j = 0; j < nJoints; j++ )
+      {
+         Joint* joint = joints[j];
+         jointCenters[j] = joint->center;
+         jointIsDynamic[j] = ( joint->type == DYNAMIC );
+         if( jointParents[j] >= 0 )
+         {
+            stages[j] = stages[ jointParents[j] ] + jointIsDynamic[ jointParents[j] ];
+         }
+         if( jointIsDynamic[j] )
+         {
+            dynamicJoints.push_back( j );
+            lastStage = max( lastStage, stages[j] );
+         }
+
+         for( vector<Joint*>::iterator kid = joint->kids.begin(); kid != joint->kids.end(); kid++ )
+         {
+            if( (*kid)->index <= (int) j )
+            {
+               cerr << "[Animator] Joint " << (*kid)->index << " is listed before its parent " << j << endl;
+            }
+            jointParents[ (*kid)->index ] = j;
+         }
+      }
+
+      integrationStages.assign( lastStage+1, vector<int>() );
+      for( size_t j = 0; j < nJoints; j++ )
+      {
+         if( stages[j] <= lastStage )
+         {
+            integrationStages[ stages[j] ].push_back( j );
+         }
+      }
+   }
+
+   void Character :: bake( int nFrames )
+   {
+      const size_t nJoints = joints.size();
+
+      bakedFrames = max( nFrames, 0 );
+      bakedAngles.assign( bakedFrames*nJoints, 0. );
+      bakedPositions.resize( bakedFrames );
+      bakedAngleError = 0.;
+      bakedPositionError = 0.;
+
+      if( bakedFrames == 0 )
+      {
+         return;
+      }
+
+      // Every frame, and halfway between frames (where the error of
+      // linear interpolation is measured).
+      const int nMidFrames = bakedFrames-1;
+      vector<double> frameTimes( bakedFrames );
+      vector<double> midTimes( nMidFrames );
+      for( int f = 0; f < bakedFrames; f++ )
+      {
+         frameTimes[f] = f;
+      }
+      for( int f = 0; f < nMidFrames; f++ )
+      {
+         midTimes[f] = f + .5;
+      }
+
+      // The splines are sampled through their published snapshots, which
+      // (unlike the splines themselves) may be read on any thread; the
+      // versions recorded are those of the snapshots.
+      bakedVersions.assign( nJoints+1, 0 );
+      vector<double> angles( bakedFrames );
+      vector<double> midAngles( nMidFrames );
+      for( size_t j = 0; j < nJoints; j++ )
+      {
+         if( joints[j]->type != KEYFRAMED ) continue;
+
+         shared_ptr<const Spline<double>::Snapshot> angle = joints[j]->angle.publishedSnapshot();
+         angle->evaluateMany( &frameTimes[0], &angles[0], bakedFrames );
+         angle->evaluateMany( midTimes.data(), midAngles.data(), nMidFrames );
+         bakedVersions[j] = angle->getVersion();
+
+         for( int f = 0; f < bakedFrames; f++ )
+         {
+            bakedAngles[ f*nJoints + j ] = angles[f];
+         }
+         for( int f = 0; f < nMidFrames; f++ )
+         {
+            double lerp = .5*( angles[f] + angles[f+1] );
+            bakedAngleError = max( bakedAngleError, fabs( lerp - midAngles[f] ) );
+         }
+      }
+
+      shared_ptr<const Spline<Vector2D>::Snapshot> path = position.publishedSnapshot();
+      vector<Vector2D> midPositions( nMidFrames );
+      path->evaluateMany( &frameTimes[0], &bakedPositions[0], bakedFrames );
+      path->evaluateMany( midTimes.data(), midPositions.data(), nMidFrames );
+      bakedVersions[ nJoints ] = path->getVersion();
+
+      for( int f = 0; f < nMidFrames; f++ )
+      {
+         Vector2D lerp = .5*( bakedPositions[f] + bakedPositions[f+1] );
+         bakedPositionError = max( bakedPositionError, ( lerp - midPositions[f] ).norm() );
+      }
+   }
+
+   void Character :: publishSplines( void )
+   {
+      for( size_t j = 0; j < joints.size(); j++ )
+      {
+         if( joints[j]->type == KEYFRAMED )
+         {
+            joints[j]->angle.publish();
+         }
+      }
+      position.publish();
+   }
+
+   bool Character :: isBaked( int nFrames ) const
    {
-      // TODO IMPLEMENT ME (TASK 3B)
+      if( bakedFrames == 0 || bakedFrames != nFrames ||
+          bakedVersions.size() != joints.size()+1 )
+      {
+         return false;
+      }
+
+      // (Compared in place, since this check runs on every update.)
+      for( size_t j = 0; j < joints.size(); j++ )
+      {
+         if( joints[j]->type == KEYFRAMED &&
+             joints[j]->getAngleSpline().getVersion() != bakedVersions[j] )
+         {
+            return false;
+         }
+      }
+      return position.getVersion() == bakedVersions[ joints.size() ];
    }
 
-   void Character :: update( double time )
+   void Character :: getSplineVersions( vector<unsigned long>& versions ) const
    {
-      currentTransformation = Matrix3x3::translation( position.evaluate( time ) );
-      root->update( time, currentTransformation );
+      versions.resize( joints.size()+1 );
+      for( size_t j = 0; j < joints.size(); j++ )
+      {
+         versions[j] = joints[j]->type == KEYFRAMED ? joints[j]->getAngleSpline().getVersion() : 0;
+      }
+      versions[ joints.size() ] = position.getVersion();
    }
 
    void Character::draw( SVGRenderer* renderer, bool pick, Joint* hovered, Joint* selected )
@@ -49,30 +1322,56 @@ namespace CMU462
    // The SVG file contains a hieracrhy of groups cooresponding to
    void Character::load_from_SVG(SVG & svg)
    {
-      Group * root_group = static_cast<Group*>(svg.elements[0]);
+      instantiate( shared_ptr<const Rig>( new Rig( svg ) ) );
+   }
+
+   void Character::instantiate( shared_ptr<const Rig> newRig )
+   {
+      rig = newRig;
+      bakedFrames = 0;
+
+      ownedJoints.clear();
+      joints.resize( rig->size() );
+      for( size_t i = 0; i < joints.size(); i++ )
+      {
+         ownedJoints.push_back( unique_ptr<Joint>( new Joint() ) );
+         Joint* joint = ownedJoints.back().get();
+         joint->index  = i;
+         joint->type   = rig->types[i];
+         joint->center = rig->centers[i];
+         joint->shapes = &rig->shapes[i];
+         joint->massProperties = &rig->jointMass[i];
+         joints[i] = joint;
+
+         if( rig->parents[i] >= 0 )
+         {
+            joints[ rig->parents[i] ]->kids.push_back( joint );
+         }
+      }
+      root = joints[0];
 
-      joints.clear();
-      root = new Joint();
-      root->index = joints.size();
-      joints.push_back(root);
+      vector<Spline<double>*> angles( joints.size(), (Spline<double>*) NULL );
+      for( size_t i = 0; i < joints.size(); i++ )
+      {
+         if( joints[i]->type == KEYFRAMED )
+         {
+            angles[i] = &joints[i]->getAngleSpline();
+         }
+      }
+      angleBank.setChannels( angles );
 
-      root->parse_from_group(root_group, *this);
+      compileJoints();
    }
 
    // The constructor sets the dynamic angle and velocity of
    // the joint to zero (at a perfect vertical with no motion)
    Joint :: Joint( void )
-   : theta( 0. ), omega( 0. )
+   : ikAngleGradient( 0. ), theta( 0. ), omega( 0. ), shapes( NULL ), massProperties( NULL )
    {}
 
+   // (The shapes belong to the rig.)
    Joint :: ~Joint( void )
-   {
-      // deallocate storage of SVG shapes
-      for( int i = 0; i < shapes.size(); i++ )
-      {
-         delete shapes[i];
-      }
-   }
+   {}
 
    double Joint::getAngle( double time )
    {
@@ -97,6 +1396,22 @@ namespace CMU462
       angle.setValue( time, value );
    }
 
+   void Joint::setAngles( const double* times, const double* values, size_t n )
+   {
+      if( type == DYNAMIC )
+      {
+         if( n > 0 )
+         {
+            theta = values[n-1];
+         }
+         return;
+      }
+
+      // type == KEYFRAMED
+      angle.setValues( times, values, n );
+      angle.publish();
+   }
+
    bool Joint::removeAngle(double time)
    {
       // Assuming times are on the integers only.
@@ -114,43 +1429,17 @@ namespace CMU462
       omega = 0.;
    }
 
-   void Joint::update( double time, Matrix3x3 parentTransformation )
-   {
-      // Calculate the cumulative transformation by composing the
-      // transformation of the parent with a rotation around the
-      // joint center.
-
-      double alpha = getAngle( time );
-      if( type == DYNAMIC )
-      {
-         // A pendulum should hang straight down; its angle should
-         // not be affected by the rotation of any joints above it.
-         alpha -= parentTransformation.getRotation();
-      }
-
-      Matrix3x3 R = Matrix3x3::rotation( alpha );
-      Matrix3x3 A = Matrix3x3::translation(  center );
-      Matrix3x3 B = Matrix3x3::translation( -center );
-      currentParentTransformation = parentTransformation;
-      currentTransformation = parentTransformation * A * R * B;
-
-      Vector3D c( center.x, center.y, 1. );
-      c = currentTransformation * c;
-      currentCenter = Vector2D( c.x/c.z, c.y/c.z );
-
-      for( vector<Joint*>::iterator joint  = kids.begin(); joint != kids.end(); joint ++ )
-      {
-         (*joint)->update( time, currentTransformation );
-      }
-   }
-
    inline double mod1(double in) { return in > 1.0 ? in - 1 : in;}
 
 
    void Joint::draw( SVGRenderer* renderer, bool pick, Joint* hovered, Joint* selected )
    {
-      for( vector<SVGElement*>::iterator shape = shapes.begin(); shape != shapes.end(); shape++ )
+      // (The shapes are shared with every other instance of the rig, so the
+      // style changes below must be undone before the next shape is drawn.)
+      for( size_t i = 0; shapes && i < shapes->size(); i++ )
       {
+         SVGElement* const* shape = &(*shapes)[i];
+
          // make a copy of the original style for this shape,
          // so that we can restore it if it's changed for either
          // picking or hovering/selection
@@ -204,110 +1493,30 @@ namespace CMU462
       }
    }
 
-   void Joint::parse_from_group(Group * G, Character & C)
-   {
-      // Attempt to parse the starting group containing the current joint's data.
-      vector<SVGElement*> & elements = G -> elements;
-      vector<SVGElement*>::iterator iter = elements.begin();
-
-      // Parse this particular group's data.
-      Group * joint_group = dynamic_cast<Group*>(*iter);
-
-      // Base Case, this is childless joint if this is not a group.
-      if(joint_group == NULL)
-      {
-         // one shape for each element,
-         //excluding the final circle which just specifies the joint
-         int nShapes = elements.size()-1;
-         shapes.resize( nShapes );
-         for( int i = 0; i < nShapes; i++ )
-         {
-            shapes[i] = (*iter)->copy();
-            iter++;
-         }
-         Circle * center_circle =  static_cast<Circle*>(*iter);
-         center = center_circle -> center;
-         setJointType( center_circle );
-         return;
-      }
-
-      // one shape for each element,
-      // excluding the final circle which just specifies the joint.
-      int nShapes = joint_group->elements.size()-1; 
-      shapes.resize( nShapes );
-      for( int i = 0; i < nShapes; i++ )
-      {
-         shapes[i] = ((joint_group->elements)[i])->copy();
-      }
-      SVGElement * svg_circle = (joint_group->elements)[nShapes];
-      Circle * center_circle  = dynamic_cast<Circle*>(svg_circle);
-
-      if(center_circle == NULL)
-      {
-         cout << svg_circle << endl;
-         cout << svg_circle->type << endl;
-         cerr << "ERROR: The Center of rotation circle was not found during joint parsing.\n";
-         exit(0);
-      }
-
-      center = center_circle -> center;
-      setJointType( center_circle );
-
-      iter++;
-
-
-      // Parse the sub joints.
-      while(iter != elements.end())
-      {
-         Joint * child = new Joint();
-
-         // Allocate new joints for the children in the Character's joints vector.
-         child->index = C.joints.size();
-         C.joints.push_back(child);
-
-         // Link each of these joints to this joint's kids array.
-         kids.push_back(child);
-
-         Group * child_group = static_cast<Group*>(*iter);
-
-         // Parse the child.
-         child -> parse_from_group(child_group, C);
-
-         // Continue on to the next child.
-         iter++;
-      }
-
-      // Done parsing subjoints.
-
-   }
-
-   void Joint :: setJointType( Circle* circle )
-   {
-      Color& c( circle->style.fillColor );
-
-      type = KEYFRAMED;
-
-      if( c.r == 1. && c.g == 1. && c.b == 1. )
-      {
-         type = DYNAMIC;
-      }
-   }
-
    void Joint :: physicalQuantities( double& m, // mass
                                      double& I, // moment of inertia
                                      Vector2D& c, // centroid
                                      Vector2D center
                                      ) const
    {
+      if( massProperties && center.x == this->center.x && center.y == this->center.y )
+      {
+         m = massProperties->mass;
+         I = massProperties->inertia;
+         c = massProperties->centroid;
+         return;
+      }
+
       m = 0.;
       I = 0.;
       c = Vector2D( 0., 0. );
 
-      for( int k = 0; k < shapes.size(); k++ )
+      for( size_t k = 0; shapes && k < shapes->size(); k++ )
       {
-         double   mk = shapes[k]->mass();
-         double   Ik = shapes[k]->momentOfInertia( center );
-         Vector2D ck = shapes[k]->centroid();
+         const SVGElement* shape = (*shapes)[k];
+         double   mk = shape->mass();
+         double   Ik = shape->momentOfInertia( center );
+         Vector2D ck = shape->centroid();
 
          m += mk;
          I += Ik;
@@ -11,7 +11,10 @@
 
 #include <vector>
 #include "svg.h"
+#include "rig.h"
+#include "pendulum.h"
 #include "spline.h"
+#include "spline_bank.h"
 #include "svg_renderer.h"
 
 using namespace std;
@@ -19,14 +22,7 @@ using namespace std;
 namespace CMU462
 {
    class Character;
-
-   // JointType specifies how a given joint gets animated: using
-   // keyframed spline animation, or dynamic simulation.
-   enum JointType
-   {
-      KEYFRAMED,
-      DYNAMIC
-   };
+   class PendulumBatch;
 
    class Joint
    {
@@ -60,12 +56,12 @@ namespace CMU462
          // track of both pieces of data is that we might also need to apply the same
          // transformation to other data.  (Likewise, it is often convenient to have
          // the current center, without needing to apply the transformation every time.)
-         Matrix3x3 currentTransformation;
+         Affine2D currentTransformation;
 
          // For convenience, we also store the current transformation of the parent joint.
          // This value is mainly useful for ensuring that pendulum joints hang "down"
          // correctly, rather than being transformed by their parent.
-         Matrix3x3 currentParentTransformation;
+         Affine2D currentParentTransformation;
          
          // Gradient of IK energy with respect to this joint angle, which will
          // be used to update the joint configurations.  This value is updated
@@ -82,6 +78,11 @@ namespace CMU462
          // method simply sets the dynamical variable at the current time to the specified value.
          void setAngle( double time, double value );
 
+         // Sets the angle at each of the given times, as setAngle() would, but
+         // modifies the spline of a keyframed joint only once for all of them,
+         // and publishes it (see Spline::publish()) once they are all set.
+         void setAngles( const double* times, const double* values, size_t n );
+
          // Removes any keyframe corresponding to the specified time.
          bool removeAngle( double time );
 
@@ -90,40 +91,59 @@ namespace CMU462
          void resetVelocity( void );
 
          // Computes the gradient of IK energy for this joint and, recursively,
-         // for all of its children, storing the result in Joint::ikAngleGradient.
-         bool calculateAngleGradient( Joint* goalJoint, Vector2D p, Vector2D ptilde );
-
-         // Recursively update the current transformation and center
-         // for this joint and all its children.
-         void update( double time, Matrix3x3 transform );
+         // for all of its children, storing the result in Joint::ikAngleGradient;
+         // returns true iff goalJoint is this joint or one of its descendants.
+         // The source point p and the target point ptilde are in world
+         // coordinates.  The angles of dynamic joints are not optimized, and do
+         // not follow the rotation of their parents; hence, when the goal lies
+         // below a dynamic joint, rotating the joints above it moves the source
+         // point only as much as the dynamic joint's center.  To account for
+         // this, the recursion shifts p and ptilde by the same amount (leaving
+         // the residual p - ptilde unchanged) so that, on return, p is the point
+         // whose motion the ancestors of this joint actually control.
+         bool calculateAngleGradient( Joint* goalJoint, Vector2D& p, Vector2D& ptilde );
 
          // Computes the total mass, moment of inertia, and center of mass relative to
          // the given center point using the joint shape as described in the SVG file.
+         // About the joint's own center, this simply returns the precomputed values
+         // of getMassProperties().
          void physicalQuantities( double& m, double& I, Vector2D& c, Vector2D center ) const;
 
-         // Recursively performs time integration for any dynamic joint.
-         void integrate( double time, double timestep, Vector2D cumulativeAcceleration );
+         // Mass properties of the shapes of this joint, with the moment of inertia
+         // taken about the joint center, as computed once by the Rig.
+         const MassProperties& getMassProperties( void ) const { return *massProperties; }
+
+         // If this joint is dynamic, advances its angle and angular velocity
+         // by the given timestep (in seconds) with the given integrator and
+         // number of substeps, assuming that its center moves with the given
+         // acceleration (see Character::integrate()).
+         void integrate( double timestep, Vector2D cumulativeAcceleration,
+                         Integrator integrator = SYMPLECTIC_EULER, int substeps = 1 );
+
+         // The equation of motion of this (dynamic) joint, given
+         // the acceleration of its center.
+         Pendulum getPendulum( Vector2D cumulativeAcceleration ) const;
 
          // Recursively draw this joint and all child joints.
          // If in picking mode, will use pseudocolors based on index.
          void draw( SVGRenderer* renderer, bool pick, Joint* hovered, Joint* selected );
 
-         // Parses a Joint from the given group.
-         void parse_from_group(Group * G, Character & C);
-
-         // Set the joint type based on the style of the given circle.
-         void setJointType( Circle* circle );
-
          // Index into the "joints" array of this Joint's Character.
-         // This value is used exclusively for OpenGL picking; it
-         // should not be used (or needed) by any other routine.
+         // This value is used for OpenGL picking, and to index the
+         // per-joint arrays of the Character (e.g., Character::pose).
          int index;
 
          // Accessors for dynamical angle variables.
          double getTheta(){ return theta; };
          double getOmega(){ return omega; };
 
+         // Accessor for the keyframed angle spline.  Any modification
+         // should go through setAngle() and removeAngle() instead.
+         Spline<double>& getAngleSpline(){ return angle; };
+
       private:
+         friend class Character;
+
          // For keyframed joints, "angle" stores the angle of the joint
          // relative to its initial rest pose.  These values are accumulated
          // along the kinematic chain to determine the current configuration
@@ -142,15 +162,59 @@ namespace CMU462
          // An array of shapes describes the appearance of the joint,
          // which get drawn back-to-front in first-to-last order.  These
          // values should NOT be needed to determine the joint motion,
-         // except by the method Joint::physicalQuantities().
-         vector<SVGElement*> shapes;
+         // except by the method Joint::physicalQuantities().  The shapes
+         // belong to the character's Rig, which every instance of the
+         // same rig shares; NULL if the joint has no shapes.
+         const vector<SVGElement*>* shapes;
+
+         // Entry of Rig::jointMass for this joint.
+         const MassProperties* massProperties;
+
+   };
 
+   // Methods for solving inverse kinematics (see Character::reachForTarget()).
+   enum IKSolver
+   {
+      GRADIENT_DESCENT,          // descent along Joint::calculateAngleGradient(), with an adaptive step
+      DAMPED_LEAST_SQUARES,      // Levenberg-Marquardt steps, using the Jacobian of the chain
+      CYCLIC_COORDINATE_DESCENT, // turns each joint in turn (from the goal up) toward the target
+      FABRIK,                    // forward and backward reaching on the positions of the joint centers
+      N_IK_SOLVERS
+   };
+
+   // Returns a human-readable name for the given IK solver.
+   const char* ikSolverName( IKSolver solver );
+
+   // An IK constraint asks for a source point on a joint, specified in the
+   // original coordinate system, to reach a target point in world coordinates.
+   // When several constraints cannot all be met, IK minimizes the sum of
+   // their squared distances, each multiplied by its weight.
+   struct IKConstraint
+   {
+      IKConstraint( Joint* joint, Vector2D sourcePoint, Vector2D targetPoint, double weight = 1. )
+      : joint( joint ), sourcePoint( sourcePoint ), targetPoint( targetPoint ), weight( weight ) {}
+
+      Joint* joint;
+      Vector2D sourcePoint;
+      Vector2D targetPoint;
+      double weight;
    };
 
    // A Character is a tree of Joints, together with some additional information.
+   // A character owns its joints, which keep their addresses for as long as it
+   // exists; characters can hence be moved (e.g., within a vector<Character>),
+   // but not copied.
    class Character
    {
       public:
+         Character();
+
+         // Characters own their joints (see above).
+         Character( Character&& ) = default;
+         Character& operator=( Character&& ) = default;
+         Character( const Character& ) = delete;
+         Character& operator=( const Character& ) = delete;
+
          // This spline determines the overall translation of the character.
          Spline<Vector2D> position;
 
@@ -160,23 +224,84 @@ namespace CMU462
          // In principal, the character could store only its root joint
          // and access its children via a tree traversal.  However, it
          // is often convenient to be able to simply iterate over a list
-         // of children.
+         // of children.  Every joint is listed after its parent (i.e.,
+         // the root comes first), as produced by load_from_SVG().  The
+         // joints are owned by the character (see ownedJoints).
          vector<Joint*> joints;
 
          // Transformation of the character at the current time,
          // as computed by the last call to Character::update().
-         Matrix3x3 currentTransformation;
+         Affine2D currentTransformation;
+
+         // The angle splines of all keyframed joints (indexed like "joints",
+         // with NULL for dynamic joints), evaluated together by update().
+         SplineBank angleBank;
+
+         // Joint angles at the current time, indexed like "joints", as
+         // computed by the last call to Character::update().  For dynamic
+         // joints, this is the angle theta with the vertical.
+         vector<double> pose;
 
          // Computes the joint transformations and joint center for the
          // specified time, storing these values in Joint::currentTransformation and
-         // Joint::currentCenter, respectively.
-         void update( double time );
+         // Joint::currentCenter, respectively.  Dynamic joints are posed the given
+         // fraction of the way from their state before the last call to integrate()
+         // to their current state, so that the display can be interpolated between
+         // simulation steps (see SimulationClock).  Only what changed since the
+         // last call is recomputed: at the same time, only the splines modified
+         // since are evaluated again, and only the subtrees below joints whose
+         // angle changed (or all joints, if the character moved) are transformed.
+         void update( double time, double dynamicsBlend = 1. );
+
+         // Like update(), but takes the character transformation and the
+         // angles of the keyframed joints (indexed like "joints"; entries of
+         // dynamic joints are ignored) as given, rather than evaluating the
+         // splines, e.g., to copy the pose of another instance of the same rig.
+         void setPose( const Affine2D& transformation, const vector<double>& angles );
 
          // For any joint whose motion is determined by dynamics rather than spline
          // animation, integrate() updates the dynamic variables theta and omega
-         // via numerical integration using the given time step.
+         // via numerical integration using the given time step (in seconds),
+         // starting at the given time (in frames).  The acceleration of the center
+         // of each joint is derived from the current pose (see update()), the
+         // keyframed motion at the given time, and the joints above it.  The
+         // animator integrates with integrateBatched() instead, whose results
+         // agree with this method only to within rounding (see pendulum_batch.h).
          void integrate( double time, double timestep );
 
+         // integrate(), split into stages, so that the pendulums of many characters
+         // can be stepped together (see integrateBatched()): after beginIntegration(),
+         // for each stage in turn, gatherPendulums() appends the equation of motion
+         // and the state of every dynamic joint of that stage to the batch, and once
+         // the batch has been integrated, scatterPendulums() reads back their new
+         // state.  Stage s holds the dynamic joints with s dynamic ancestors, whose
+         // pivots only depend on the dynamic joints of earlier stages.  Stages from
+         // getIntegrationStages() on are empty, so that the characters of a scene
+         // may all be visited for as many stages as the deepest one needs.
+         int getIntegrationStages( void ) const { return integrationStages.size(); }
+         void beginIntegration( void );
+         void gatherPendulums( int stage, double time, PendulumBatch& batch );
+         void scatterPendulums( int stage, const PendulumBatch& batch, double timestep );
+
+         // Resets the dynamic variables of every joint (see Joint::resetDynamics()).
+         void resetDynamics( void );
+
+         // The dynamic state of the character, i.e., theta and omega of every
+         // dynamic joint (in order), can be copied to and from an array of
+         // getDynamicStateSize() values, e.g., to checkpoint a simulation.
+         size_t getDynamicStateSize( void ) const { return 2*dynamicJoints.size(); }
+         void getDynamicState( double* state ) const;
+         void setDynamicState( const double* state );
+
+         // The scheme used by integrate(), and the number of equal
+         // substeps into which it divides each time step.
+         Integrator integrator;
+         int substeps;
+
+         // Duration of an animation frame in seconds, used to convert
+         // the derivatives of the splines (per frame) to physical units.
+         double secondsPerFrame;
+
          // draws the character using the specified renderer;
          // note that the layering of joints is determined by
          // a depth-first traversal of the tree (depth-first
@@ -197,8 +322,238 @@ namespace CMU462
                Vector2D targetPoint, // target point q, expressed in the world coordinate system (this is the mouse cursor position, so there is no notion of "before" and "after" transformation)
                double time );
 
+         // Runs the IK solver on the current pose (as computed by the last call
+         // to update()), without keying any angles, and returns the number of
+         // iterations taken.  The solved pose is stored in "pose" and in the
+         // joint transformations.
+         int solveIK( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint );
+
+         // Like reachForTarget() and solveIK(), but for any number of
+         // constraints at once, e.g., to pin both hands and a foot.  Each
+         // iteration gathers the contributions of all constraints in a single
+         // pass over the joints.  Only gradient descent and damped least squares
+         // support several constraints; the other solvers fall back to the
+         // latter.  Converged once every source point is within ikTolerance.
+         void reachForTargets( const vector<IKConstraint>& constraints, double time );
+         int solveIK( const vector<IKConstraint>& constraints );
+
+         // Solves reachForTarget() for the given source point at every frame
+         // firstFrame, firstFrame+1, ..., with the target at the matching entry
+         // of "targets" (or at every integer frame from firstFrame to lastFrame,
+         // with the target given by the spline), and keys the angles of the
+         // joints that move the source point at each of those frames.  A coarse
+         // serial pass first solves every few frames, each starting from the
+         // solution before it, so that the pose follows the targets coherently;
+         // the remaining frames are then solved independently (in parallel
+         // when OpenMP is enabled), each starting from the coarse solutions
+         // around it.  Every frame starts with the current dynamic state.
+         // Returns the number of frames that converged.
+         int bakeIK( Joint* goalJoint, Vector2D sourcePoint, const vector<Vector2D>& targets, int firstFrame );
+         int bakeIK( Joint* goalJoint, Vector2D sourcePoint, Spline<Vector2D>& targets, int firstFrame, int lastFrame );
+
+         // Keys, at the given time, the given angles (indexed like "joints") of
+         // all keyframed joints that move the source point of any constraint,
+         // as reachForTargets() does with the solved pose.
+         void keyIKSolution( const vector<IKConstraint>& constraints, const vector<double>& angles, double time );
+
+         // The method used by reachForTarget(), which takes at most
+         // ikMaxIterations steps, stopping early once the source point
+         // is within ikTolerance (in pixels) of the target.
+         IKSolver ikSolver;
+         int ikMaxIterations;
+         double ikTolerance;
+
+         // Damping of the DAMPED_LEAST_SQUARES solver, in pixels: the
+         // length of a residual that is corrected only halfway by a
+         // step around a joint a unit distance away.  Larger values
+         // give smaller but more stable steps near singularities.
+         double ikDamping;
+
          // Loads this character from an svg grouping representation.
          void load_from_SVG(SVG & svg);
+
+         // Replaces the joints of this character by a new instance of the
+         // given rig, whose shapes are shared rather than copied.  All joints
+         // start in the rest pose, without any keyframes.  Any number of
+         // characters may be instantiated from the same rig.  The previous
+         // joints are deleted, so any pointer to them becomes invalid.
+         void instantiate( shared_ptr<const Rig> rig );
+
+         // The rig this character was instantiated from.
+         shared_ptr<const Rig> getRig( void ) const { return rig; }
+
+         // Rebuilds the flattened copy of the joint tree used by update().
+         // Must be called whenever joints are added, removed, or change
+         // type or center; load_from_SVG() calls it automatically.
+         void compileJoints( void );
+
+         // Samples the position spline and the angle splines of all keyframed
+         // joints at every integer frame 0, ..., nFrames-1 into contiguous
+         // tables.  As long as these tables reflect the current splines,
+         // update() simply reads them for times within the baked range, rather
+         // than evaluating the splines.  The bake also measures the largest
+         // error of linear interpolation between frames versus the splines
+         // (see bakedAngleError and bakedPositionError).  Only the published
+         // snapshots of the splines are read (see publishSplines()), so the
+         // bake may run on any thread while the splines are being edited.
+         void bake( int nFrames );
+
+         // Publishes the current keyframes of the position spline and the
+         // angle splines of all keyframed joints (see Spline::publish()),
+         // making them visible to bake().  Called by the editing thread at the
+         // end of each batch of edits (e.g., once per keyed frame of a drag).
+         void publishSplines( void );
+
+         // Returns true iff the baked tables cover nFrames frames and
+         // no spline has been modified since they were computed.
+         bool isBaked( int nFrames ) const;
+
+         // Stores the versions of the angle splines (indexed like "joints",
+         // with zero for dynamic joints) followed by that of the position
+         // spline, which together change whenever any key frame does.
+         void getSplineVersions( vector<unsigned long>& versions ) const;
+
+         // If true, update() linearly interpolates between baked frames at
+         // non-integer times; otherwise (the default) it evaluates the splines
+         // at such times.  Since playback updates characters at fractional
+         // times, enabling this trades the Hermite curves for a piecewise-linear
+         // approximation, whose error (see below) should be checked first.
+         bool bakeInterpolation;
+
+         // Largest deviation of linearly interpolated baked values from the
+         // splines, measured halfway between frames by the last call to bake()
+         // (in radians for joint angles, and in pixels for the position).
+         double bakedAngleError;
+         double bakedPositionError;
+
+      private:
+         // Shared geometry of the joints (see instantiate()).
+         shared_ptr<const Rig> rig;
+
+         // The joints listed in "joints", which are deleted together
+         // with the character (or by the next call to instantiate()).
+         vector< unique_ptr<Joint> > ownedJoints;
+
+         // The joint tree flattened into arrays indexed like "joints", so
+         // that update() is a single loop over the joints in order, in which
+         // each parent is visited before its children.
+         vector<int>       jointParents;         // index of the parent, or -1 for the root
+         vector<Vector2D>  jointCenters;         // rest-pose centers (Joint::center)
+         vector<char>      jointIsDynamic;       // true iff the joint type is DYNAMIC
+         vector<size_t>    dynamicJoints;        // indices of all dynamic joints
+         vector<Affine2D>  jointTransformations; // current transformations
+
+         // Computes the current transformation and center of every joint
+         // from the character transformation and the joint angles in "pose",
+         // and copies them to the joints.  Dynamic joints are blended as in update().
+         // Joints whose angle and ancestors are unchanged since the last call
+         // are skipped (see transformedPose).
+         void updateJoints( double dynamicsBlend = 1. );
+
+         // The angles of the dynamic joints (indexed like "dynamicJoints")
+         // before the last call to integrate(); empty if there was none
+         // since the dynamics were last reset.
+         vector<double> previousDynamicAngles;
+
+         // The solvers used by solveIK().
+         int solveIKGradientDescent( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint );
+         int solveIKCyclicCoordinateDescent( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint );
+         int solveIKFABRIK( Joint* goalJoint, Vector2D sourcePoint, Vector2D targetPoint );
+         int solveIKGradientDescent( const vector<IKConstraint>& constraints );
+         int solveIKDampedLeastSquares( const vector<IKConstraint>& constraints );
+
+         // Returns true iff every constraint is met to within ikTolerance.
+         bool ikConverged( const vector<IKConstraint>& constraints ) const;
+
+         // Stores the gradient of the weighted IK energy of all constraints with
+         // respect to every joint angle in Joint::ikAngleGradient, accumulated in
+         // a single pass from the leaves up; returns the energy.
+         double computeIKGradient( const vector<IKConstraint>& constraints );
+
+         // Scratch space for the solvers with several constraints: per joint,
+         // whether any constraint lies below, the subtree sums of computeIKGradient(),
+         // and the Jacobian columns (two entries per constraint); per joint and
+         // constraint, whether the constraint lies below and the point the joint
+         // moves for it; and the normal equations of damped least squares.
+         vector<char>     ikMoved;
+         vector<Vector2D> ikSubtreeResiduals;
+         vector<double>   ikSubtreeMoments;
+         vector<double>   ikColumns;
+         vector<char>     ikBelow;
+         vector<Vector2D> ikConstraintLevers;
+         vector<double>   ikNormalMatrix;
+         vector<double>   ikResidual;
+
+         // Collects the keyframed joints that move the world point p on the
+         // given joint, in a single pass from the joint up to the root.  For
+         // each one (from the bottom up), ikChain receives its index, ikCenters
+         // its current center, ikLevers the point it moves rigidly (p itself,
+         // or the center of the nearest dynamic joint below it), and ikJacobian
+         // the derivative of p with respect to its angle.
+         void computeIKChain( Joint* goalJoint, Vector2D p );
+         vector<int>      ikChain;
+         vector<Vector2D> ikCenters;
+         vector<Vector2D> ikLevers;
+         vector<Vector2D> ikJacobian;
+
+         // Scratch space for the FABRIK solver.
+         vector<Vector2D> ikFabrikCenters;
+         vector<Vector2D> ikFabrikLevers;
+
+         // Step size of the GRADIENT_DESCENT solver, adapted from
+         // one step to the next (in radians per squared pixel).
+         double ikGradientStep;
+
+         // Instances of the rig used by the parallel pass of bakeIK(), one per
+         // thread, kept from one bake to the next (and freed with the character).
+         vector< unique_ptr<Character> > ikBakeSolvers;
+
+         // Scratch space for integrate(): the angular velocity and angular
+         // acceleration of every joint, and the acceleration of its center.
+         vector<double>   jointAngularVelocities;
+         vector<double>   jointAngularAccelerations;
+         vector<Vector2D> jointAccelerations;
+
+         // Computes the acceleration of the center of the given joint at the
+         // given time and, if it is keyframed, its angular velocity and
+         // acceleration, from those of its parent (see integrate()).
+         void computeJointMotion( int j, double time );
+
+         // Sets the state of the given dynamic joint after a step of the given
+         // size, and derives its angular velocity and acceleration.
+         void finishPendulumStep( int j, double theta, double omega, double timestep );
+
+         // The joints visited by each stage of the integration (see
+         // gatherPendulums()) in order, up to the last stage with a dynamic
+         // joint, and the index in the batch of every dynamic joint.
+         vector< vector<int> > integrationStages;
+         vector<size_t> jointBatchIndices;
+
+         // Baked tables (see bake()).  The angles of frame f are stored
+         // contiguously, in the same layout as "pose", starting at
+         // bakedAngles[ f*joints.size() ].
+         int bakedFrames;
+         vector<double> bakedAngles;
+         vector<Vector2D> bakedPositions;
+
+         // spline versions (see getSplineVersions()) when the tables were baked
+         vector<unsigned long> bakedVersions;
+
+         // The time and spline versions of the last call to update(), and
+         // whether "pose" still holds the angles it evaluated, in which case
+         // another call for the same time re-evaluates only modified splines.
+         double updatedTime;
+         vector<unsigned long> updatedVersions;
+         bool updatedPoseValid;
+         vector<unsigned long> splineVersions;
+
+         // The pose and character transformation that jointTransformations
+         // were last computed from, so that updateJoints() only recomputes
+         // the subtrees below joints whose angle changed, and whether each
+         // joint was recomputed by the last call.
+         vector<double> transformedPose;
+         Affine2D transformedTransformation;
+         vector<char> jointChanged;
    };
 }
 
@@ -0,0 +1,99 @@
+/*
+ * Implementation of the DynamicsCheckpoints class.
+ */
+
+#include "dynamics_checkpoints.h"
+
+namespace CMU462
+{
+   DynamicsCheckpoints :: DynamicsCheckpoints( int interval )
+   : interval( interval < 1 ? 1 : interval )
+   {}
+
+   void DynamicsCheckpoints :: setInterval( int interval )
+   {
+      this->interval = interval < 1 ? 1 : interval;
+      clear();
+   }
+
+   bool DynamicsCheckpoints :: validate( const vector<Character>& actors )
+   {
+      vector<unsigned long> current;
+      getSignature( actors, current );
+
+      if( current == signature )
+      {
+         return false;
+      }
+
+      states.clear();
+      signature.swap( current );
+      return true;
+   }
+
+   void DynamicsCheckpoints :: record( int frame, const vector<Character>& actors )
+   {
+      if( frame <= 0 || frame % interval != 0 || states.count( frame ) )
+      {
+         return;
+      }
+
+      vector<double>& state( states[ frame ] );
+      for( size_t i = 0; i < actors.size(); i++ )
+      {
+         size_t offset = state.size();
+         state.resize( offset + actors[i].getDynamicStateSize() );
+         actors[i].getDynamicState( &state[ offset ] );
+      }
+   }
+
+   int DynamicsCheckpoints :: find( int frame ) const
+   {
+      map< int, vector<double> >::const_iterator c = states.upper_bound( frame );
+      if( c == states.begin() )
+      {
+         return 0;
+      }
+      return (--c)->first;
+   }
+
+   void DynamicsCheckpoints :: restore( int frame, vector<Character>& actors ) const
+   {
+      map< int, vector<double> >::const_iterator c = states.find( frame );
+      if( c == states.end() )
+      {
+         // Only the rest state at frame 0 is known without a checkpoint.
+         for( size_t i = 0; i < actors.size(); i++ )
+         {
+            actors[i].resetDynamics();
+         }
+         return;
+      }
+
+      const double* state = c->second.data();
+      for( size_t i = 0; i < actors.size(); i++ )
+      {
+         actors[i].setDynamicState( state );
+         state += actors[i].getDynamicStateSize();
+      }
+   }
+
+   void DynamicsCheckpoints :: clear( void )
+   {
+      states.clear();
+   }
+
+   void DynamicsCheckpoints :: getSignature( const vector<Character>& actors, vector<unsigned long>& signature )
+   {
+      signature.clear();
+
+      vector<unsigned long> versions;
+      for( size_t i = 0; i < actors.size(); i++ )
+      {
+         actors[i].getSplineVersions( versions );
+         signature.insert( signature.end(), versions.begin(), versions.end() );
+         signature.push_back( actors[i].integrator );
+         signature.push_back( actors[i].substeps );
+      }
+   }
+}
@@ -0,0 +1,85 @@
+#ifndef DYNAMICS_CHECKPOINTS_H
+#define DYNAMICS_CHECKPOINTS_H
+
+/*
+ * DynamicsCheckpoints class.
+ *
+ * Purpose : Makes it cheap to jump to any frame of an animation whose
+ *           dynamic joints are simulated.  The state of a simulation at a
+ *           given frame depends on every earlier frame, so rather than
+ *           replaying the simulation from the start, it is replayed from
+ *           the nearest earlier checkpoint.
+ *
+ * - A checkpoint stores the dynamic state (theta and omega of every dynamic
+ *   joint of every character) at a frame that is a multiple of the interval;
+ *   frame 0 is always the rest state, and needs no checkpoint.
+ * - Checkpoints are recorded as the simulation reaches those frames (during
+ *   playback, export, or replay), so a seek costs at most one interval's
+ *   worth of simulation steps once the animation has been played.
+ * - All checkpoints are dropped whenever anything the simulation depends on
+ *   changes: the characters, their splines, or their integrators.
+ *
+ */
+
+#include <map>
+#include <vector>
+#include "character.h"
+
+using namespace std;
+
+namespace CMU462
+{
+   class DynamicsCheckpoints
+   {
+      public:
+         DynamicsCheckpoints( int interval = 30 );
+
+         // The number of frames between checkpoints.  Changing
+         // it drops all checkpoints.
+         void setInterval( int interval );
+         int getInterval( void ) const { return interval; }
+
+         // Drops all checkpoints if the given characters differ from those
+         // the checkpoints were recorded from, or if any of their splines or
+         // integrators changed since.  Call before find() or record().  Returns
+         // true iff the checkpoints were dropped, in which case any simulation
+         // state computed before the change is stale as well, and the caller
+         // must restore( find( frame ) ) before simulating any further.
+         bool validate( const vector<Character>& actors );
+
+         // Stores the dynamic state of the given characters, which must
+         // have been simulated up to the given frame, if it is a (positive)
+         // multiple of the interval without a checkpoint yet.
+         void record( int frame, const vector<Character>& actors );
+
+         // Returns the latest frame no later than the given frame at which
+         // the dynamic state is known, i.e., a checkpoint or else frame 0.
+         int find( int frame ) const;
+
+         // Sets the dynamic state of the given characters to that at the
+         // given frame, as returned by find().
+         void restore( int frame, vector<Character>& actors ) const;
+
+         // Drops all checkpoints.
+         void clear( void );
+
+         // Number of checkpoints currently stored.
+         size_t size( void ) const { return states.size(); }
+
+      private:
+         int interval;
+
+         // The dynamic state of every character at each checkpoint frame,
+         // concatenated in the layout of Character::getDynamicState().
+         map< int, vector<double> > states;
+
+         // Spline versions, integrators and numbers of substeps of
+         // all characters when the checkpoints were recorded.
+         vector<unsigned long> signature;
+
+         // Stores the current signature of the given characters.
+         static void getSignature( const vector<Character>& actors, vector<unsigned long>& signature );
+   };
+}
+
+#endif // DYNAMICS_CHECKPOINTS_H
@@ -50,7 +50,7 @@ void HardwareRenderer::draw_svg( SVG& svg ) {
   begin2DDrawing();
 
   // set top level transformation
-  transformation.push( canvas_to_screen );
+  transformation.push( Affine2Df( canvas_to_screen ) );
 
   // draw all elements
   for ( size_t i = 0; i < svg.elements.size(); ++i ) {
@@ -190,9 +190,12 @@ void HardwareRenderer::draw_polygon( Polygon& polygon ) {
   c = polygon.style.fillColor;
   if( c.a != 0 ) {
 
-    // triangulate
-    vector<Vector2D> triangles;
-    triangulate( polygon, triangles );
+    // triangulate (unless already done)
+    vector<Vector2D> computedTriangles;
+    if( polygon.triangles.empty() ) {
+      triangulate( polygon, computedTriangles );
+    }
+    const vector<Vector2D>& triangles = polygon.triangles.empty() ? computedTriangles : polygon.triangles;
 
     // draw as triangles
     int n = triangles.size();
@@ -16,7 +16,7 @@ class HardwareRenderer : public SVGRenderer {
 
   HardwareRenderer()
   {
-     transformation.push( Matrix3x3::identity() );
+     transformation.push( Affine2Df::identity() );
   }
 
   // Implements Renderer
@@ -0,0 +1,226 @@
+/*
+ * Implementation of the IKWorker class.
+ */
+
+#include "ik_worker.h"
+
+#include "CMU462/timer.h"
+
+// Smallest decrease of the distance between the source point and the
+// target (in pixels) over a whole budget for the worker to keep going
+// when the target cannot be reached.
+const double ikStallDistance = 1e-3;
+
+namespace CMU462
+{
+   IKWorker :: IKWorker( double budget )
+   : budget( budget ),
+     quit( false ),
+     active( false ),
+     problemVersion( 0 ),
+     targetVersion( 0 ),
+     budgetGranted( false ),
+     converged( false ),
+     publishedVersion( 0 ),
+     fetchedVersion( 0 ),
+     solvingVersion( 0 )
+   {}
+
+   IKWorker :: ~IKWorker( void )
+   {
+      {
+         unique_lock<mutex> guard( stateMutex );
+         quit = true;
+      }
+      wakeup.notify_one();
+
+      if( worker.joinable() )
+      {
+         worker.join();
+      }
+   }
+
+   void IKWorker :: start( const Character& character, const Joint* goalJoint, Vector2D sourcePoint )
+   {
+      {
+         unique_lock<mutex> guard( stateMutex );
+
+         problem.rig = character.getRig();
+         problem.transformation = character.currentTransformation;
+         problem.angles = character.pose;
+         problem.dynamicState.resize( character.getDynamicStateSize() );
+         if( !problem.dynamicState.empty() )
+         {
+            character.getDynamicState( &problem.dynamicState[0] );
+         }
+         problem.goalIndex = goalJoint->index;
+         problem.sourcePoint = sourcePoint;
+         problem.solver = character.ikSolver;
+         problem.tolerance = character.ikTolerance;
+         problem.damping = character.ikDamping;
+         problemVersion++;
+
+         active = true;
+         targetVersion = 0;
+         budgetGranted = false;
+         converged = false;
+
+         // Poses published for any previous problem are stale.
+         fetchedVersion = publishedVersion;
+      }
+
+      if( !worker.joinable() )
+      {
+         worker = thread( &IKWorker::run, this );
+      }
+   }
+
+   void IKWorker :: setTarget( Vector2D target )
+   {
+      {
+         unique_lock<mutex> guard( stateMutex );
+
+         if( targetVersion == 0 || target.x != targetPoint.x || target.y != targetPoint.y )
+         {
+            targetPoint = target;
+            targetVersion++;
+            converged = false;
+         }
+         budgetGranted = true;
+      }
+      wakeup.notify_one();
+   }
+
+   bool IKWorker :: fetch( vector<double>& angles )
+   {
+      unique_lock<mutex> guard( stateMutex );
+
+      if( publishedVersion == fetchedVersion )
+      {
+         return false;
+      }
+      angles = publishedAngles;
+      fetchedVersion = publishedVersion;
+      return true;
+   }
+
+   void IKWorker :: stop( void )
+   {
+      unique_lock<mutex> guard( stateMutex );
+      active = false;
+   }
+
+   bool IKWorker :: isConverged( void )
+   {
+      unique_lock<mutex> guard( stateMutex );
+      return converged;
+   }
+
+   void IKWorker :: run( void )
+   {
+      unique_lock<mutex> guard( stateMutex );
+
+      while( true )
+      {
+         while( !quit && !( active && targetVersion > 0 && budgetGranted && !converged ) )
+         {
+            if( !active && character.getRig() )
+            {
+               // Once stopped, free the joints of the last problem (and let
+               // go of its rig) rather than holding them until the next one.
+               problem.rig.reset();
+               solving.rig.reset();
+               solvingVersion = 0;
+               guard.unlock();
+               character = Character();
+               guard.lock();
+               continue;
+            }
+            wakeup.wait( guard );
+         }
+         if( quit )
+         {
+            return;
+         }
+         budgetGranted = false;
+
+         // Take a copy of the request, so that the render thread can
+         // go on setting targets (or problems) while we solve.
+         unsigned long version = problemVersion;
+         unsigned long target = targetVersion;
+         Vector2D targetPoint = this->targetPoint;
+         bool newProblem = ( version != solvingVersion );
+         if( newProblem )
+         {
+            solving = problem;
+            solvingVersion = version;
+         }
+         guard.unlock();
+
+         if( newProblem )
+         {
+            if( character.getRig() != solving.rig )
+            {
+               character.instantiate( solving.rig );
+            }
+            character.ikSolver = solving.solver;
+            character.ikTolerance = solving.tolerance;
+            character.ikDamping = solving.damping;
+
+            // One iteration per call to solveIK(), so that
+            // the budget is checked after every iteration.
+            character.ikMaxIterations = 1;
+
+            if( !solving.dynamicState.empty() )
+            {
+               character.setDynamicState( &solving.dynamicState[0] );
+            }
+            character.setPose( solving.transformation, solving.angles );
+         }
+
+         bool done = solve( targetPoint );
+
+         guard.lock();
+
+         // Drop the result if start() was called in the meantime.
+         if( problemVersion != version )
+         {
+            continue;
+         }
+         publishedAngles = character.pose;
+         publishedVersion++;
+         if( done && targetVersion == target )
+         {
+            converged = true;
+         }
+      }
+   }
+
+   bool IKWorker :: solve( Vector2D targetPoint )
+   {
+      Timer timer;
+      timer.start();
+
+      Joint* goalJoint = character.joints[ solving.goalIndex ];
+      vector<IKConstraint> constraints( 1, IKConstraint( goalJoint, solving.sourcePoint, targetPoint ) );
+
+      double initialDistance = ( goalJoint->currentTransformation * solving.sourcePoint - targetPoint ).norm();
+      while( true )
+      {
+         // (The solver takes no iteration once converged.)
+         if( character.solveIK( constraints ) == 0 )
+         {
+            return true;
+         }
+
+         timer.stop();
+         if( timer.duration() >= budget )
+         {
+            break;
+         }
+      }
+
+      double distance = ( goalJoint->currentTransformation * solving.sourcePoint - targetPoint ).norm();
+      return initialDistance - distance < ikStallDistance;
+   }
+}
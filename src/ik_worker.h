@@ -0,0 +1,133 @@
+#ifndef IK_WORKER_H
+#define IK_WORKER_H
+
+/*
+ * IKWorker class.
+ *
+ * Purpose : Solves inverse kinematics for interactive dragging on a
+ *           background thread, so that the editor keeps drawing at the
+ *           display rate however long the chain is and however slowly
+ *           the solver converges.
+ *
+ * - The worker solves on its own instance of the dragged character's rig,
+ *   starting from a copy of the character's pose, so that it never touches
+ *   the characters being drawn or edited.
+ * - Each call to setTarget() (once per frame) hands the worker the latest
+ *   cursor position and grants it a fixed time budget; within the budget it
+ *   takes as many solver iterations as it can, continuing from the best pose
+ *   found so far, and then publishes that pose.
+ * - The render thread picks up published poses with fetch() and keys them
+ *   itself, so the splines are only ever modified by that thread.
+ * - Once the source point has reached the target (or stopped getting any
+ *   closer), the worker sleeps until the target moves.
+ * - Starting a problem on a different rig replaces the worker's instance
+ *   (see Character::instantiate(), which frees the previous joints).
+ *
+ */
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "character.h"
+
+using namespace std;
+
+namespace CMU462
+{
+   class IKWorker
+   {
+      public:
+         // The worker spends at most the given number of
+         // seconds solving per call to setTarget().
+         IKWorker( double budget = .004 );
+         ~IKWorker();
+
+         // Starts solving for the given source point (in the original
+         // coordinate system) on the given joint of the given character,
+         // replacing any previous problem.  Solving starts from the current
+         // pose of the character (as computed by its last call to update()),
+         // with its IK solver settings.  The thread is started on first use.
+         void start( const Character& character, const Joint* goalJoint, Vector2D sourcePoint );
+
+         // Sets the target point (in world coordinates) and grants the
+         // worker another time budget for reaching it, unless it has
+         // converged for this target already.
+         void setTarget( Vector2D targetPoint );
+
+         // If a pose newer than the last one fetched has been published
+         // since the last call to start(), copies its joint angles (indexed
+         // like Character::joints) and returns true.
+         bool fetch( vector<double>& angles );
+
+         // Stops solving; the worker frees its instance of the rig and
+         // sleeps until the next call to start().
+         void stop( void );
+
+         // Returns true iff the worker has converged for the current target.
+         bool isConverged( void );
+
+      private:
+         // The body of the thread.
+         void run( void );
+
+         // Takes solver iterations for the current problem until the budget
+         // is spent; returns true iff the solver has converged or stalled.
+         bool solve( Vector2D targetPoint );
+
+         double budget;
+
+         thread worker;
+         mutex stateMutex;
+         condition_variable wakeup;
+
+         // Everything start() copies from the character.
+         struct Problem
+         {
+            shared_ptr<const Rig> rig;
+            Affine2D transformation;
+            vector<double> angles;
+            vector<double> dynamicState;
+            int goalIndex;
+            Vector2D sourcePoint;
+            IKSolver solver;
+            double tolerance;
+            double damping;
+         };
+
+         // The following is guarded by stateMutex.
+
+         bool quit;
+         bool active;
+
+         // The problem set by start(), counted by problemVersion.
+         Problem problem;
+         unsigned long problemVersion;
+
+         // The latest target (counted by targetVersion), whether the
+         // worker may spend another budget on it, and whether it has
+         // converged for it.
+         Vector2D targetPoint;
+         unsigned long targetVersion;
+         bool budgetGranted;
+         bool converged;
+
+         // The latest published pose, counted by publishedVersion,
+         // and the version last returned by fetch().
+         vector<double> publishedAngles;
+         unsigned long publishedVersion;
+         unsigned long fetchedVersion;
+
+         // Used by the thread only: the problem being solved, its
+         // version, and the character it is solved on.
+         Problem solving;
+         unsigned long solvingVersion;
+         Character character;
+
+         // Workers own a thread, and are not copied.
+         IKWorker( const IKWorker& );
+         IKWorker& operator=( const IKWorker& );
+   };
+}
+
+#endif // IK_WORKER_H
@@ -3,11 +3,13 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <iostream>
+#include <cstring>
 
 
 #include "CMU462/CMU462.h"
 #include "CMU462/viewer.h"
 #include "character.h"
+#include "benchmark.h"
 
 
 using namespace std;
@@ -97,6 +99,14 @@ int loadPath( Animator * editor, const char* path) {
 
 int main( int argc, char** argv ) {
 
+  // run benchmarks without opening a window
+  if( argc >= 3 && !strcmp( argv[1], "-benchmark" ) ) {
+    for( int i = 2; i < argc; i++ ) {
+      if( benchmarkIntegrators( argv[i] ) < 0 || benchmarkPendulumBatch( argv[i] ) < 0 || benchmarkIK( argv[i] ) < 0 || benchmarkIKBake( argv[i] ) < 0 ) return 1;
+    }
+    return benchmarkScene( argc-2, argv+2 ) < 0 ? 1 : 0;
+  }
+
   // create viewer
   Viewer viewer = Viewer();
 
@@ -110,7 +120,8 @@ int main( int argc, char** argv ) {
   if( argc == 2 ) {
     if (loadPath(animation_editor, argv[1]) < 0) exit(0);
   } else {
-    msg("Usage: ./animator <path to test file or directory>"); exit(0);
+    msg("Usage: ./animator <path to test file or directory>");
+    msg("       ./animator -benchmark <path to test file> [<path to test file> ...]"); exit(0);
   }
 
   // init viewer
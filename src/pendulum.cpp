@@ -0,0 +1,106 @@
+/*
+ * Implementation of the pendulum integrators.
+ */
+
+#include "pendulum.h"
+
+#include <cmath>
+
+namespace CMU462
+{
+   const char* integratorName( Integrator integrator )
+   {
+      switch( integrator )
+      {
+         case SYMPLECTIC_EULER: return "symplectic Euler";
+         case VELOCITY_VERLET:  return "velocity Verlet";
+         case RUNGE_KUTTA_4:    return "RK4";
+         default:               return "unknown";
+      }
+   }
+
+   // The center of mass is at r = rotation( theta ) * centerOfMass (see
+   // Affine2D::rotation()), so that dr/dtheta = ( r.y, -r.x ), and the
+   // torque of gravity g (per unit moment of inertia) is m/I g . dr/dtheta.
+   double Pendulum :: acceleration( double theta ) const
+   {
+      const double c = cos( theta );
+      const double s = sin( theta );
+      const double rx =  c*centerOfMass.x + s*centerOfMass.y;
+      const double ry = -s*centerOfMass.x + c*centerOfMass.y;
+
+      return massOverInertia * ( gravity.x*ry - gravity.y*rx );
+   }
+
+   double Pendulum :: energy( double theta, double omega ) const
+   {
+      const double c = cos( theta );
+      const double s = sin( theta );
+      const double rx =  c*centerOfMass.x + s*centerOfMass.y;
+      const double ry = -s*centerOfMass.x + c*centerOfMass.y;
+
+      return .5*omega*omega - massOverInertia * ( gravity.x*rx + gravity.y*ry );
+   }
+
+   double Pendulum :: energyScale( void ) const
+   {
+      return massOverInertia * gravity.norm() * centerOfMass.norm();
+   }
+
+   void integratePendulum( const Pendulum& pendulum,
+                           Integrator integrator,
+                           int substeps,
+                           double timestep,
+                           double& theta,
+                           double& omega )
+   {
+      substeps = substeps < 1 ? 1 : substeps;
+      const double h = timestep / substeps;
+
+      switch( integrator )
+      {
+         case SYMPLECTIC_EULER:
+            for( int k = 0; k < substeps; k++ )
+            {
+               omega += h * pendulum.acceleration( theta );
+               theta += h * omega;
+            }
+            break;
+
+         case VELOCITY_VERLET:
+         {
+            // The acceleration at the end of each substep
+            // is reused at the beginning of the next one.
+            double a = pendulum.acceleration( theta );
+            for( int k = 0; k < substeps; k++ )
+            {
+               theta += h*omega + .5*h*h*a;
+               double aNext = pendulum.acceleration( theta );
+               omega += .5*h*( a + aNext );
+               a = aNext;
+            }
+            break;
+         }
+
+         case RUNGE_KUTTA_4:
+            for( int k = 0; k < substeps; k++ )
+            {
+               double k1theta = omega;
+               double k1omega = pendulum.acceleration( theta );
+               double k2theta = omega + .5*h*k1omega;
+               double k2omega = pendulum.acceleration( theta + .5*h*k1theta );
+               double k3theta = omega + .5*h*k2omega;
+               double k3omega = pendulum.acceleration( theta + .5*h*k2theta );
+               double k4theta = omega + h*k3omega;
+               double k4omega = pendulum.acceleration( theta + h*k3theta );
+
+               theta += h/6. * ( k1theta + 2.*k2theta + 2.*k3theta + k4theta );
+               omega += h/6. * ( k1omega + 2.*k2omega + 2.*k3omega + k4omega );
+            }
+            break;
+
+         default:
+            break;
+      }
+   }
+}
@@ -0,0 +1,73 @@
+#ifndef PENDULUM_H
+#define PENDULUM_H
+
+/*
+ * Pendulum dynamics of dynamic joints.
+ *
+ * Purpose : Describes the equation of motion of a single dynamic joint, and
+ *           provides several numerical integrators for it, so that accuracy
+ *           can be traded against cost (see Character::integrator).
+ *
+ * - A dynamic joint is a rigid pendulum swinging around its center, whose
+ *   angle theta is measured from its rest pose (theta = 0 hangs the joint
+ *   as drawn in the SVG file).
+ * - The pivot may accelerate (e.g., when the character or the joints above
+ *   it move); in the frame of the pivot this simply adds to gravity.
+ * - Each integrator advances (theta, omega) by a timestep, split into a
+ *   given number of equal substeps.
+ *
+ */
+
+#include "CMU462/vector2D.h"
+
+namespace CMU462
+{
+   // Numerical schemes for advancing a pendulum in time.
+   enum Integrator
+   {
+      SYMPLECTIC_EULER, // first order, one force evaluation per substep
+      VELOCITY_VERLET,  // second order, one force evaluation per substep
+      RUNGE_KUTTA_4,    // fourth order (but not symplectic), four evaluations per substep
+      N_INTEGRATORS
+   };
+
+   // Returns a human-readable name for the given integrator.
+   const char* integratorName( Integrator integrator );
+
+   // The equation of motion theta'' = acceleration( theta ) of a pendulum.
+   struct Pendulum
+   {
+      Pendulum() : massOverInertia( 0. ) {}
+
+      // Ratio of the mass to the moment of inertia about the pivot.
+      double massOverInertia;
+
+      // Offset of the center of mass from the pivot at theta = 0.
+      Vector2D centerOfMass;
+
+      // Gravity minus the acceleration of the pivot.
+      Vector2D gravity;
+
+      // Angular acceleration at the given angle.
+      double acceleration( double theta ) const;
+
+      // Total energy, divided by the moment of inertia, at the given state.
+      // This quantity is conserved by the exact motion.
+      double energy( double theta, double omega ) const;
+
+      // Scale of the potential energy (divided by the moment of inertia),
+      // used to express energy errors in relative terms.
+      double energyScale( void ) const;
+   };
+
+   // Advances the state (theta, omega) of the given pendulum by the
+   // given timestep, using the given number of equal substeps.
+   void integratePendulum( const Pendulum& pendulum,
+                           Integrator integrator,
+                           int substeps,
+                           double timestep,
+                           double& theta,
+                           double& omega );
+}
+
+#endif // PENDULUM_H
@@ -0,0 +1,311 @@
+/*
+ * Implementation of the PendulumBatch class.
+ */
+
+#include "pendulum_batch.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+// Reduction of angles to [-pi/4, pi/4]: pi/2 split into three parts, the
+// first two of which have few enough bits that their products with the
+// (small) number of quarter turns are exact (Cody and Waite).
+const double twoOverPi = 0.636619772367581343076;
+const double piOverTwo1 = 1.57079625129699707031e0;
+const double piOverTwo2 = 7.54978941586159635335e-8;
+const double piOverTwo3 = 5.39030285815811905290e-15;
+
+// Polynomial approximations of sin( z ) / z - 1 and of cos( z ) - 1 + z^2/2,
+// in powers of z^2 (highest first), on [-pi/4, pi/4] (from the Cephes library).
+const double sinePolynomial[6] =
+{
+    1.58962301576546568060e-10,
+   -2.50507477628578072866e-8,
+    2.75573136213857245213e-6,
+   -1.98412698295895385996e-4,
+    8.33333333332211858878e-3,
+   -1.66666666666666307295e-1
+};
+const double cosinePolynomial[6] =
+{
+   -1.13585365213876817300e-11,
+    2.08757008419747316778e-9,
+   -2.75573141792967388112e-7,
+    2.48015872888517045348e-5,
+   -1.38888888888730564116e-3,
+    4.16666666666665929218e-2
+};
+
+namespace CMU462
+{
+   // Operations on a register of "laneCount" doubles.
+
+#if defined( __AVX2__ )
+
+   typedef __m256d Lanes;
+   const int laneCount = 4;
+
+   static inline Lanes load( const double* p ) { return _mm256_loadu_pd( p ); }
+   static inline void store( double* p, Lanes x ) { _mm256_storeu_pd( p, x ); }
+   static inline Lanes broadcast( double x ) { return _mm256_set1_pd( x ); }
+   static inline Lanes addLanes( Lanes a, Lanes b ) { return _mm256_add_pd( a, b ); }
+   static inline Lanes subtractLanes( Lanes a, Lanes b ) { return _mm256_sub_pd( a, b ); }
+   static inline Lanes multiplyLanes( Lanes a, Lanes b ) { return _mm256_mul_pd( a, b ); }
+
+   // a where the mask is set, and b elsewhere
+   static inline Lanes select( Lanes mask, Lanes a, Lanes b ) { return _mm256_blendv_pd( b, a, mask ); }
+   static inline Lanes negateWhere( Lanes mask, Lanes x ) { return _mm256_xor_pd( x, _mm256_and_pd( mask, _mm256_set1_pd( -0. ) ) ); }
+
+   // conversions to and from one 32-bit integer per lane
+   static inline __m128i roundToInt( Lanes x ) { return _mm256_cvtpd_epi32( x ); }
+   static inline Lanes fromInt( __m128i n ) { return _mm256_cvtepi32_pd( n ); }
+   static inline Lanes isNonzero( __m128i n ) { return _mm256_cmp_pd( fromInt( n ), _mm256_setzero_pd(), _CMP_NEQ_OQ ); }
+
+#elif defined( __SSE2__ )
+
+   typedef __m128d Lanes;
+   const int laneCount = 2;
+
+   static inline Lanes load( const double* p ) { return _mm_loadu_pd( p ); }
+   static inline void store( double* p, Lanes x ) { _mm_storeu_pd( p, x ); }
+   static inline Lanes broadcast( double x ) { return _mm_set1_pd( x ); }
+   static inline Lanes addLanes( Lanes a, Lanes b ) { return _mm_add_pd( a, b ); }
+   static inline Lanes subtractLanes( Lanes a, Lanes b ) { return _mm_sub_pd( a, b ); }
+   static inline Lanes multiplyLanes( Lanes a, Lanes b ) { return _mm_mul_pd( a, b ); }
+
+   static inline Lanes select( Lanes mask, Lanes a, Lanes b ) { return _mm_or_pd( _mm_and_pd( mask, a ), _mm_andnot_pd( mask, b ) ); }
+   static inline Lanes negateWhere( Lanes mask, Lanes x ) { return _mm_xor_pd( x, _mm_and_pd( mask, _mm_set1_pd( -0. ) ) ); }
+
+   static inline __m128i roundToInt( Lanes x ) { return _mm_cvtpd_epi32( x ); }
+   static inline Lanes fromInt( __m128i n ) { return _mm_cvtepi32_pd( n ); }
+   static inline Lanes isNonzero( __m128i n ) { return _mm_cmpneq_pd( fromInt( n ), _mm_setzero_pd() ); }
+
+#else
+
+   typedef double Lanes;
+   const int laneCount = 1;
+
+   static inline Lanes load( const double* p ) { return *p; }
+   static inline void store( double* p, Lanes x ) { *p = x; }
+   static inline Lanes broadcast( double x ) { return x; }
+   static inline Lanes addLanes( Lanes a, Lanes b ) { return a + b; }
+   static inline Lanes subtractLanes( Lanes a, Lanes b ) { return a - b; }
+   static inline Lanes multiplyLanes( Lanes a, Lanes b ) { return a * b; }
+
+#endif
+
+   static inline Lanes polynomial( Lanes x, const double* c )
+   {
+      Lanes y = broadcast( c[0] );
+      for( int i = 1; i < 6; i++ )
+      {
+         y = addLanes( multiplyLanes( y, x ), broadcast( c[i] ) );
+      }
+      return y;
+   }
+
+   // Computes the sine and cosine of every lane.
+   static inline void sinCos( Lanes x, Lanes& s, Lanes& c )
+   {
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+      // x = z + n pi/2, with |z| <= pi/4.
+      __m128i n = roundToInt( multiplyLanes( x, broadcast( twoOverPi ) ) );
+      Lanes y = fromInt( n );
+      Lanes z = subtractLanes( subtractLanes( subtractLanes( x, multiplyLanes( y, broadcast( piOverTwo1 ) ) ),
+                                  multiplyLanes( y, broadcast( piOverTwo2 ) ) ),
+                                  multiplyLanes( y, broadcast( piOverTwo3 ) ) );
+
+      Lanes zz = multiplyLanes( z, z );
+      Lanes sz = addLanes( z, multiplyLanes( multiplyLanes( z, zz ), polynomial( zz, sinePolynomial ) ) );
+      Lanes cz = addLanes( subtractLanes( broadcast( 1. ), multiplyLanes( broadcast( .5 ), zz ) ),
+                      multiplyLanes( multiplyLanes( zz, zz ), polynomial( zz, cosinePolynomial ) ) );
+
+      // Each quarter turn maps ( sin, cos ) to ( cos, -sin ).
+      Lanes odd = isNonzero( _mm_and_si128( n, _mm_set1_epi32( 1 ) ) );
+      Lanes negateSine = isNonzero( _mm_and_si128( n, _mm_set1_epi32( 2 ) ) );
+      Lanes negateCosine = isNonzero( _mm_and_si128( _mm_add_epi32( n, _mm_set1_epi32( 1 ) ), _mm_set1_epi32( 2 ) ) );
+
+      s = negateWhere( negateSine, select( odd, cz, sz ) );
+      c = negateWhere( negateCosine, select( odd, sz, cz ) );
+#else
+      s = sin( x );
+      c = cos( x );
+#endif
+   }
+
+   // The angular acceleration P cos( theta ) + Q sin( theta ).
+   static inline Lanes acceleration( Lanes theta, Lanes P, Lanes Q )
+   {
+      Lanes s, c;
+      sinCos( theta, s, c );
+      return addLanes( multiplyLanes( P, c ), multiplyLanes( Q, s ) );
+   }
+
+   int PendulumBatch :: getLaneCount( void )
+   {
+      return laneCount;
+   }
+
+   PendulumBatch :: PendulumBatch( void )
+   : count( 0 )
+   {}
+
+   void PendulumBatch :: clear( void )
+   {
+      count = 0;
+      theta.clear();
+      omega.clear();
+      cosineCoefficients.clear();
+      sineCoefficients.clear();
+   }
+
+   // With r = rotation( theta ) * centerOfMass (see Pendulum::acceleration()),
+   //    g.x r.y - g.y r.x = cos( theta ) ( g.x c.y - g.y c.x ) - sin( theta ) ( g.x c.x + g.y c.y ).
+   size_t PendulumBatch :: add( const Pendulum& pendulum, double theta, double omega )
+   {
+      const Vector2D& c( pendulum.centerOfMass );
+      const Vector2D& g( pendulum.gravity );
+
+      this->theta.push_back( theta );
+      this->omega.push_back( omega );
+      cosineCoefficients.push_back(  pendulum.massOverInertia * ( g.x*c.y - g.y*c.x ) );
+      sineCoefficients.push_back( -pendulum.massOverInertia * ( g.x*c.x + g.y*c.y ) );
+
+      return count++;
+   }
+
+   void PendulumBatch :: integrate( Integrator integrator, int substeps, double timestep )
+   {
+      substeps = substeps < 1 ? 1 : substeps;
+      const double step = timestep / substeps;
+
+      // Pad with motionless pendulums to a whole number of registers.
+      const size_t padded = ( count + laneCount-1 ) / laneCount * laneCount;
+      theta.resize( padded, 0. );
+      omega.resize( padded, 0. );
+      cosineCoefficients.resize( padded, 0. );
+      sineCoefficients.resize( padded, 0. );
+
+      // (The arithmetic follows integratePendulum() step for step.)
+      const Lanes h = broadcast( step );
+      const Lanes halfH = broadcast( .5*step );
+      const Lanes halfHH = broadcast( .5*step*step );
+      const Lanes sixthH = broadcast( step/6. );
+      const Lanes two = broadcast( 2. );
+
+      for( size_t i = 0; i < padded; i += laneCount )
+      {
+         Lanes t = load( &theta[i] );
+         Lanes w = load( &omega[i] );
+         const Lanes P = load( &cosineCoefficients[i] );
+         const Lanes Q = load( &sineCoefficients[i] );
+
+         switch( integrator )
+         {
+            case SYMPLECTIC_EULER:
+               for( int k = 0; k < substeps; k++ )
+               {
+                  w = addLanes( w, multiplyLanes( h, acceleration( t, P, Q ) ) );
+                  t = addLanes( t, multiplyLanes( h, w ) );
+               }
+               break;
+
+            case VELOCITY_VERLET:
+            {
+               Lanes a = acceleration( t, P, Q );
+               for( int k = 0; k < substeps; k++ )
+               {
+                  t = addLanes( t, addLanes( multiplyLanes( h, w ), multiplyLanes( halfHH, a ) ) );
+                  Lanes aNext = acceleration( t, P, Q );
+                  w = addLanes( w, multiplyLanes( halfH, addLanes( a, aNext ) ) );
+                  a = aNext;
+               }
+               break;
+            }
+
+            case RUNGE_KUTTA_4:
+               for( int k = 0; k < substeps; k++ )
+               {
+                  Lanes k1t = w;
+                  Lanes k1w = acceleration( t, P, Q );
+                  Lanes k2t = addLanes( w, multiplyLanes( halfH, k1w ) );
+                  Lanes k2w = acceleration( addLanes( t, multiplyLanes( halfH, k1t ) ), P, Q );
+                  Lanes k3t = addLanes( w, multiplyLanes( halfH, k2w ) );
+                  Lanes k3w = acceleration( addLanes( t, multiplyLanes( halfH, k2t ) ), P, Q );
+                  Lanes k4t = addLanes( w, multiplyLanes( h, k3w ) );
+                  Lanes k4w = acceleration( addLanes( t, multiplyLanes( h, k3t ) ), P, Q );
+
+                  t = addLanes( t, multiplyLanes( sixthH, addLanes( addLanes( addLanes( k1t, multiplyLanes( two, k2t ) ), multiplyLanes( two, k3t ) ), k4t ) ) );
+                  w = addLanes( w, multiplyLanes( sixthH, addLanes( addLanes( addLanes( k1w, multiplyLanes( two, k2w ) ), multiplyLanes( two, k3w ) ), k4w ) ) );
+               }
+               break;
+
+            default:
+               break;
+         }
+
+         store( &theta[i], t );
+         store( &omega[i], w );
+      }
+
+      // Drop the padding, so that add() may append again.
+      theta.resize( count );
+      omega.resize( count );
+      cosineCoefficients.resize( count );
+      sineCoefficients.resize( count );
+   }
+
+   void integrateBatched( vector<Character>& characters, double time, double timestep, PendulumBatch& batch )
+   {
+      // The characters are integrated in groups that share an integrator
+      // and a number of substeps, in order of their first member.
+      vector<char> integrated( characters.size(), false );
+      vector<size_t> group;
+      for( size_t first = 0; first < characters.size(); first++ )
+      {
+         if( integrated[ first ] )
+         {
+            continue;
+         }
+
+         const Integrator integrator = characters[ first ].integrator;
+         const int substeps = characters[ first ].substeps;
+
+         int nStages = 0;
+         group.clear();
+         for( size_t i = first; i < characters.size(); i++ )
+         {
+            Character& character( characters[i] );
+            if( !integrated[i] && character.integrator == integrator && character.substeps == substeps )
+            {
+               integrated[i] = true;
+               group.push_back( i );
+               character.beginIntegration();
+               nStages = max( nStages, character.getIntegrationStages() );
+            }
+         }
+
+         for( int stage = 0; stage < nStages; stage++ )
+         {
+            batch.clear();
+            for( size_t k = 0; k < group.size(); k++ )
+            {
+               characters[ group[k] ].gatherPendulums( stage, time, batch );
+            }
+
+            batch.integrate( integrator, substeps, timestep );
+
+            for( size_t k = 0; k < group.size(); k++ )
+            {
+               characters[ group[k] ].scatterPendulums( stage, batch, timestep );
+            }
+         }
+      }
+   }
+}
@@ -0,0 +1,86 @@
+#ifndef PENDULUM_BATCH_H
+#define PENDULUM_BATCH_H
+
+/*
+ * PendulumBatch class.
+ *
+ * Purpose : Steps many independent pendulums (see pendulum.h) at once, e.g.,
+ *           every dynamic joint of every character in the scene, rather than
+ *           one joint at a time during a traversal of each character.
+ *
+ * - The state and parameters of the pendulums are stored as a structure of
+ *   arrays, so that the integrators run on several pendulums per SIMD
+ *   register: four with AVX2, two with SSE2, or one otherwise.
+ * - The equation of motion of each pendulum is reduced to
+ *      theta'' = P cos( theta ) + Q sin( theta ),
+ *   and the sine and cosine are evaluated by a vectorized polynomial, which
+ *   agrees with the standard library to within a few units in the last place.
+ * - The arrays are padded with motionless pendulums to a whole number of
+ *   registers, so every pendulum takes exactly the same arithmetic; a step
+ *   hence does not depend on where a pendulum lies in the batch.
+ * - Pendulums whose pivots are carried by other pendulums must wait for
+ *   those to be stepped first; integrateBatched() handles this by stepping
+ *   the dynamic joints of a scene in stages (see Character::gatherPendulums()).
+ * - Because of the polynomial sine and cosine, a batched step agrees with
+ *   the scalar one of integratePendulum() (and Character::integrate()) only
+ *   to within rounding, i.e., to about 1e-15 radians per step, although this
+ *   may grow as chaotic motion amplifies it.  Hence integrateBatched() steps
+ *   every character through a batch, whatever its integrator, so that the
+ *   dynamics of a scene (and its checkpoints) never depend on which path a
+ *   character took.
+ *
+ */
+
+#include <vector>
+#include "pendulum.h"
+#include "character.h"
+
+using namespace std;
+
+namespace CMU462
+{
+   class PendulumBatch
+   {
+      public:
+         PendulumBatch();
+
+         // Removes all pendulums.
+         void clear( void );
+
+         // Appends a pendulum with the given state; returns its index.
+         size_t add( const Pendulum& pendulum, double theta, double omega );
+
+         // Number of pendulums.
+         size_t size( void ) const { return count; }
+
+         // Advances every pendulum by the given timestep, using the given
+         // integrator and number of equal substeps (see integratePendulum()).
+         void integrate( Integrator integrator, int substeps, double timestep );
+
+         // State of the pendulum with the given index.
+         double getTheta( size_t i ) const { return theta[i]; }
+         double getOmega( size_t i ) const { return omega[i]; }
+
+         // Number of pendulums stepped together by integrate().
+         static int getLaneCount( void );
+
+      private:
+         size_t count;
+
+         // State and coefficients P and Q of the equation of motion of
+         // every pendulum, padded by integrate() (see above).
+         vector<double> theta;
+         vector<double> omega;
+         vector<double> cosineCoefficients;
+         vector<double> sineCoefficients;
+   };
+
+   // Integrates the dynamic joints of all of the given characters, as
+   // Character::integrate() does for each one (up to rounding, see above),
+   // but stepping the pendulums of all characters together in the given
+   // batch, stage by stage.  Characters with different integrators or numbers
+   // of substeps are stepped in separate batches, one per combination.
+   void integrateBatched( vector<Character>& characters, double time, double timestep, PendulumBatch& batch );
+}
+
+#endif // PENDULUM_BATCH_H
@@ -0,0 +1,117 @@
+/*
+ * Implementation of the Rig class.
+ */
+
+#include "rig.h"
+#include "triangulation.h"
+
+#include <iostream>
+#include <cstdlib>
+
+namespace CMU462
+{
+   Rig :: Rig( SVG& svg )
+   {
+      Group * root_group = static_cast<Group*>(svg.elements[0]);
+      parse_from_group( root_group, -1 );
+
+      computeMassProperties();
+   }
+
+   Rig :: ~Rig( void )
+   {
+      // deallocate storage of SVG shapes
+      for( size_t j = 0; j < shapes.size(); j++ )
+      {
+         for( size_t i = 0; i < shapes[j].size(); i++ )
+         {
+            delete shapes[j][i];
+         }
+      }
+   }
+
+   void Rig :: parse_from_group( Group * G, int parent )
+   {
+      vector<SVGElement*> & elements = G -> elements;
+
+      // Parse this particular group's data.
+      Group * joint_group = dynamic_cast<Group*>(elements[0]);
+
+      // Base Case, this is childless joint if this is not a group;
+      // one shape for each element, excluding the final circle which
+      // just specifies the joint.
+      if(joint_group == NULL)
+      {
+         int nShapes = elements.size()-1;
+         addJoint( parent, &elements[0], nShapes, static_cast<Circle*>(elements[nShapes]) );
+         return;
+      }
+
+      vector<SVGElement*> & joint_elements = joint_group->elements;
+      int nShapes = joint_elements.size()-1;
+      SVGElement * svg_circle = joint_elements[nShapes];
+      Circle * center_circle  = dynamic_cast<Circle*>(svg_circle);
+
+      if(center_circle == NULL)
+      {
+         cout << svg_circle << endl;
+         cout << svg_circle->type << endl;
+         cerr << "ERROR: The Center of rotation circle was not found during joint parsing.\n";
+         exit(0);
+      }
+
+      int index = size();
+      addJoint( parent, nShapes > 0 ? &joint_elements[0] : NULL, nShapes, center_circle );
+
+      // Parse the sub joints.
+      for( size_t i = 1; i < elements.size(); i++ )
+      {
+         parse_from_group( static_cast<Group*>(elements[i]), index );
+      }
+   }
+
+   void Rig :: addJoint( int parent, SVGElement* const* jointShapes, int nShapes, Circle* circle )
+   {
+      parents.push_back( parent );
+      centers.push_back( circle->center );
+
+      Color& c( circle->style.fillColor );
+      types.push_back( ( c.r == 1. && c.g == 1. && c.b == 1. ) ? DYNAMIC : KEYFRAMED );
+
+      shapes.push_back( vector<SVGElement*>( nShapes ) );
+      for( int i = 0; i < nShapes; i++ )
+      {
+         SVGElement* shape = jointShapes[i]->copy();
+         shapes.back()[i] = shape;
+
+         // Triangulate the fill once, rather than on every draw.
+         if( shape->type == POLYGON )
+         {
+            Polygon* polygon = static_cast<Polygon*>( shape );
+            triangulate( *polygon, polygon->triangles );
+         }
+      }
+   }
+
+   void Rig :: computeMassProperties( void )
+   {
+      const size_t nJoints = size();
+      jointMass.assign( nJoints, MassProperties() );
+
+      for( size_t j = 0; j < nJoints; j++ )
+      {
+         MassProperties& p( jointMass[j] );
+         for( size_t k = 0; k < shapes[j].size(); k++ )
+         {
+            const SVGElement* shape = shapes[j][k];
+            double mk = shape->mass();
+            p.mass     += mk;
+            p.inertia  += shape->momentOfInertia( centers[j] );
+            p.centroid += mk*shape->centroid();
+         }
+
+         // Turn the mass-weighted sum of centroids into the center of mass.
+         p.centroid /= p.mass;
+      }
+   }
+}
@@ -0,0 +1,95 @@
+#ifndef RIG_H
+#define RIG_H
+
+/*
+ * Rig class.
+ *
+ * Purpose : Holds the parts of a character that never change during
+ *           animation---the joint hierarchy, the centers of rotation, the
+ *           joint types, and the shapes describing the appearance of each
+ *           joint---so that they can be shared by many characters.
+ *
+ * - A rig is parsed once from an SVG file and is read-only afterwards.
+ * - Every Character created from a rig (see Character::instantiate())
+ *   refers to the rig's shapes rather than copying them, so an additional
+ *   instance of the same rig costs only its own splines, dynamical state
+ *   and transformations.
+ * - Polygon fills are triangulated once, when the rig is parsed, rather
+ *   than every time they are drawn.
+ * - Likewise, the mass properties of each joint are computed once,
+ *   so that the dynamics never need to visit the shapes.
+ *
+ */
+
+#include <vector>
+#include "svg.h"
+
+using namespace std;
+
+namespace CMU462
+{
+   // JointType specifies how a given joint gets animated: using
+   // keyframed spline animation, or dynamic simulation.
+   enum JointType
+   {
+      KEYFRAMED,
+      DYNAMIC
+   };
+
+   // The total mass, moment of inertia about a joint center, and
+   // center of mass of a set of shapes.
+   struct MassProperties
+   {
+      MassProperties() : mass( 0. ), inertia( 0. ) {}
+
+      double mass;
+      double inertia;
+      Vector2D centroid;
+   };
+
+   class Rig
+   {
+      public:
+         // Parses a rig from an svg grouping representation.  Every joint
+         // is a group whose last element is a circle marking the center of
+         // rotation (white for dynamic joints), preceded by its shapes and
+         // followed by the groups of its children.
+         Rig( SVG& svg );
+         ~Rig();
+
+         // Number of joints.
+         size_t size( void ) const { return centers.size(); }
+
+         // For each joint, the index of its parent (or -1 for the root), its
+         // center of rotation in the rest pose, its type, and its shapes
+         // (drawn back-to-front in first-to-last order).  Joints are listed
+         // in depth-first order, so that every joint comes after its parent.
+         vector<int> parents;
+         vector<Vector2D> centers;
+         vector<JointType> types;
+         vector< vector<SVGElement*> > shapes;
+
+         // For each joint, the mass properties of its own shapes, with the
+         // moment of inertia about the joint center.  (These only depend on
+         // the shapes, which never change once parsed.)
+         vector<MassProperties> jointMass;
+
+      private:
+         // Appends the joint described by the given group,
+         // followed by all of its descendants.
+         void parse_from_group( Group* G, int parent );
+
+         // Appends a joint with copies of the given shapes,
+         // whose center and type are given by the given circle.
+         void addJoint( int parent, SVGElement* const* shapes, int nShapes, Circle* circle );
+
+         // Computes jointMass.
+         void computeMassProperties( void );
+
+         // Rigs own their shapes, and are shared rather than copied.
+         Rig( const Rig& );
+         Rig& operator=( const Rig& );
+   };
+}
+
+#endif // RIG_H
@@ -0,0 +1,47 @@
+/*
+ * Implementation of the SimulationClock class.
+ */
+
+#include "simulation_clock.h"
+
+#include <cmath>
+
+namespace CMU462
+{
+   SimulationClock :: SimulationClock( double timestep, int maxStepsPerAdvance )
+   : timestep( timestep ),
+     maxStepsPerAdvance( maxStepsPerAdvance ),
+     accumulator( 0. ),
+     droppedSteps( 0 )
+   {}
+
+   int SimulationClock :: advance( double elapsedSeconds )
+   {
+      if( elapsedSeconds > 0. )
+      {
+         accumulator += elapsedSeconds;
+      }
+
+      double steps = floor( accumulator / timestep );
+      accumulator = fmax( 0., accumulator - steps * timestep );
+
+      // Drop whatever the cap does not allow us to catch up on.
+      if( steps > maxStepsPerAdvance )
+      {
+         droppedSteps += (unsigned long) ( steps - maxStepsPerAdvance );
+         steps = maxStepsPerAdvance;
+      }
+
+      return (int) steps;
+   }
+
+   double SimulationClock :: getBlend( void ) const
+   {
+      return fmin( accumulator / timestep, 1. );
+   }
+
+   void SimulationClock :: reset( void )
+   {
+      accumulator = 0.;
+   }
+}
@@ -0,0 +1,57 @@
+#ifndef SIMULATION_CLOCK_H
+#define SIMULATION_CLOCK_H
+
+/*
+ * SimulationClock class.
+ *
+ * Purpose : Decouples the rate at which the animation is simulated from the
+ *           rate at which it is displayed, so that playback proceeds in real
+ *           time no matter how often the screen is redrawn.
+ *
+ * - Elapsed wall-clock time is added to an accumulator, which is consumed in
+ *   whole steps of a fixed length (one animation frame); the remainder
+ *   carries over to the next call.
+ * - The fraction of a step left in the accumulator tells how far the display
+ *   is between the last two simulated states (see getBlend()).
+ * - To avoid falling ever further behind when simulating a step takes longer
+ *   than displaying one, at most a fixed number of steps are taken per call,
+ *   and any time beyond that is dropped.
+ *
+ */
+
+namespace CMU462
+{
+   class SimulationClock
+   {
+      public:
+         // Creates a clock taking steps of the given length (in seconds),
+         // and at most maxStepsPerAdvance of them per call to advance().
+         SimulationClock( double timestep = 1./60., int maxStepsPerAdvance = 1 );
+
+         // Adds the given elapsed wall-clock time (in seconds), and returns
+         // the number of whole steps that are now due.
+         int advance( double elapsedSeconds );
+
+         // Returns the fraction (in [0,1)) of a step left in the accumulator.
+         double getBlend( void ) const;
+
+         // Empties the accumulator, e.g., when playback starts.
+         void reset( void );
+
+         double getTimestep( void ) const { return timestep; }
+
+         // Total number of steps dropped because they exceeded the cap.
+         unsigned long getDroppedSteps( void ) const { return droppedSteps; }
+
+      private:
+         double timestep;
+         int maxStepsPerAdvance;
+
+         // wall-clock time not yet consumed by a step, in seconds
+         double accumulator;
+
+         unsigned long droppedSteps;
+   };
+}
+
+#endif // SIMULATION_CLOCK_H
@@ -9,7 +9,18 @@
  */
 
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <iterator>
 #include <cmath>
+#include <memory>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "CMU462/vector2D.h"
+
 using namespace std;
 
 namespace CMU462
@@ -18,22 +29,170 @@ namespace CMU462
    class Spline
    {
       public:
-         Spline(){}
+         Spline() : coefficientsDirty( false ), published( emptySnapshot() ) {}
          ~Spline(){}
 
          // for each knot value (specified by a double), this map stores
-         // the associated value (specified by an object of type T)
+         // the associated value (specified by an object of type T).
+         // The map is the editable representation of the spline; it
+         // should only be modified via setValue() and removeKnot(), so
+         // that the compiled playback arrays (see below) stay in sync.
          map<double,T> knots;
 
          // convenience types
          typedef typename map<double,T>::iterator       KnotIter;
          typedef typename map<double,T>::const_iterator KnotCIter;
 
+         class Snapshot;
+
+         // A Cursor remembers the knot interval found by the most recent
+         // evaluation.  Since playback, drawing and frame export all sample
+         // time monotonically, the next lookup is almost always the same
+         // interval or the one right after it, which the cursor finds in
+         // O(1) instead of searching all knots.  A cursor is invalidated
+         // automatically whenever the knots are modified via setValue() or
+         // removeKnot().
+         class Cursor
+         {
+            public:
+               Cursor() : valid( false ), version( 0 ) {}
+
+               // Forget the remembered interval, forcing a full search.
+               void reset( void ) { valid = false; }
+
+            private:
+               friend class Snapshot;
+
+               bool valid;
+               unsigned long version; // Snapshot::version when upper was found
+               size_t upper; // index of the first knot strictly after the last query time
+         };
+
+         // The value of the spline together with its first
+         // and second derivatives at a given time.
+         struct Sample
+         {
+            T value;
+            T d1; // first derivative
+            T d2; // second derivative
+         };
+
+         // An immutable, compiled copy of the knots at some version of the
+         // spline.  Edits only mark the published snapshot as stale; a new
+         // one is built on demand by snapshot() or publish(), so that a run
+         // of edits (e.g., keying every frame of a drag) costs a single copy.
+         // Snapshots already handed out stay valid and unchanged for as long
+         // as someone holds them.  Hence a snapshot may be evaluated on any
+         // thread without locking, even while the spline itself is edited.
+         class Snapshot
+         {
+            public:
+               Snapshot() : version( 0 ) {}
+
+               // Same as the corresponding methods of Spline.  Each thread
+               // must use its own cursors.
+               T evaluate( double time, int derivative, Cursor& cursor ) const;
+               template<int D> T evaluate( double time, Cursor& cursor ) const;
+               Sample evaluateAll( double time, Cursor& cursor ) const;
+               void evaluateMany( const double* times, T* out, size_t n, int derivative = 0 ) const;
+
+               // The version of the spline this snapshot was taken from.
+               unsigned long getVersion( void ) const { return version; }
+
+               const vector<double>& getKnotTimes( void ) const { return knotTimes; }
+               const vector<T>& getKnotValues( void ) const { return knotValues; }
+               const vector<T>& getSegmentCoefficients( void ) const { return segmentCoefficients; }
+
+            private:
+               friend class Spline<T>;
+
+               // Incremented on every modification of the knots, so that any
+               // cached lookup into the knots can be detected as stale.
+               unsigned long version;
+
+               // Compiled copy of the knot map used for playback: knot times
+               // in increasing order and the associated values, each stored
+               // contiguously so that evaluation is a binary search (or a cursor
+               // step) over dense memory rather than a walk of the map's nodes.
+               vector<double> knotTimes;
+               vector<T>      knotValues;
+
+               // For each segment i between knots i and i+1, the coefficients
+               // c0..c3 (stored at 4*i..4*i+3) of the cubic
+               //    p(s) = c0 + c1 s + c2 s^2 + c3 s^3,   s = time - knotTimes[i],
+               // so that evaluating a value or derivative is a single Horner
+               // evaluation.  Since the Catmull-Rom tangents depend on the
+               // neighboring knots, editing knot i dirties segments i-2 through i+1.
+               vector<T> segmentCoefficients;
+
+               // Returns the index of the first compiled knot whose time is strictly
+               // greater than the given time (or knotTimes.size() if there is none),
+               // starting the search from the interval remembered by the cursor.
+               size_t findUpperKnot( double time, Cursor& cursor ) const;
+
+               // Finds the segment i containing the given time and the offset s of
+               // the time from the start of the segment.  Returns false if the
+               // spline is constant at this time, in which case i is the index
+               // of the knot whose value the spline takes.
+               bool locateSegment( double time, Cursor& cursor, size_t& i, double& s ) const;
+
+               // The segment used by the previous sample of a call to evaluateMany(),
+               // given by its index and its time interval [start,end).  Initially
+               // the interval is empty, so that the first sample is always located.
+               struct BatchSegment
+               {
+                  BatchSegment() : index( 0 ), start( 0. ), end( 0. ) {}
+                  size_t index;
+                  double start, end;
+               };
+               bool locateBatchSegment( double time, Cursor& cursor, BatchSegment& segment,
+                                        size_t& i, double& s ) const;
+         };
+
+         // Returns a snapshot of the current knots, first publishing any
+         // edits made since the last one.  Must be called on the thread
+         // editing the spline.
+         shared_ptr<const Snapshot> snapshot( void );
+
+         // Returns the most recently published snapshot of the spline.  This
+         // is the only method that may be called from a thread other than the
+         // one editing the spline; the snapshot can then be evaluated there
+         // for as long as it is held, regardless of later edits.  Edits are
+         // seen only once the editing thread calls publish() or snapshot().
+         shared_ptr<const Snapshot> publishedSnapshot( void ) const;
+
+         // Compiles the current knots and makes a copy of them available to
+         // publishedSnapshot(), unless no knot changed since the last call.
+         void publish( void );
+
          // Returns the interpolated value.  Optionally, one can request
          // a derivative of the spline (0 = no derivative, 1 = first derivative,
          // 2 = 2nd derivative).
          T evaluate( double time, int derivative = 0 );
 
+         // Same as above, but uses (and updates) the given cursor to locate
+         // the knot interval containing the given time.  Callers that sample
+         // a spline in order (e.g., once per frame) should keep one cursor
+         // per sequence of queries.
+         T evaluate( double time, int derivative, Cursor& cursor );
+
+         // Same as above, but with the derivative (0, 1 or 2) fixed at compile
+         // time, e.g., spline.evaluate<1>( time ) for the first derivative.
+         template<int D> T evaluate( double time );
+         template<int D> T evaluate( double time, Cursor& cursor );
+
+         // Returns the value, first and second derivative at the given
+         // time, locating the knot interval only once for all three.
+         Sample evaluateAll( double time );
+         Sample evaluateAll( double time, Cursor& cursor );
+
+         // Evaluates the spline (or the given derivative) at each of the n
+         // times, storing the results in out.  Samples are typically given in
+         // increasing order (e.g., when drawing or exporting), which lets the
+         // whole batch share a single cursor.  For Spline<double> and
+         // Spline<Vector2D> the polynomial evaluation is vectorized with SSE2.
+         void evaluateMany( const double* times, T* out, size_t n, int derivative = 0 );
+
          // Purely for convenience, returns the exact same
          // value as Spline::evaluate()---simply lets one
          // evaluate a spline f as though it were a function f(t)
@@ -44,11 +203,76 @@ namespace CMU462
          // creating a new knot at this time if necessary.
          void setValue( double time, T value );
 
+         // Sets the values at many times at once, as setValue() would one by one.
+         void setValues( const double* times, const T* values, size_t n );
+
          // Removes the knot closest to the given time, within the
          // given tolerance. Returns true iff a knot was removed.
          bool removeKnot( double time, double tolerance = .001 );
-         
+
+         // Removes every interior knot that the interpolation of the remaining
+         // knots reproduces to within the given tolerance, i.e., such that the
+         // reduced spline never deviates from the original one by more than
+         // the tolerance at any original knot time or halfway between two of
+         // them.  The first and last knots are always kept.  Returns the
+         // number of knots removed.
+         size_t reduceKnots( double tolerance );
+
+         // Recomputes the polynomial coefficients of any segment whose
+         // knots (or neighboring knots) changed since the last call.  This
+         // method is called automatically by evaluate(), but may also be
+         // called ahead of time, e.g., right after loading or editing.
+         void compile( void );
+
+         // Read-only access to the compiled representation, for code that
+         // evaluates many splines together (see SplineBank).  The arrays
+         // reflect the current knots only after a call to compile(); the
+         // version changes whenever the knots are modified.
+         unsigned long getVersion( void ) const { return current.version; }
+         const vector<double>& getKnotTimes( void ) const { return current.knotTimes; }
+         const vector<T>& getKnotValues( void ) const { return current.knotValues; }
+         const vector<T>& getSegmentCoefficients( void ) const { return current.segmentCoefficients; }
+
       protected:
+         // The compiled knots, updated in place by every edit and used
+         // for evaluation on the editing thread.  Published snapshots
+         // are copies of it.
+         Snapshot current;
+
+         // Segments of the current snapshot whose coefficients are out of date.
+         vector<char> segmentDirty;
+         bool         coefficientsDirty; // true iff any segment is dirty
+
+         // The snapshot returned by publishedSnapshot(), which is only
+         // ever read or replaced atomically.  It is stale whenever its
+         // version differs from that of the current knots.
+         shared_ptr<const Snapshot> published;
+
+         // A snapshot without knots, shared by all splines that have never
+         // been edited (e.g., those of every joint of a new character).
+         static const shared_ptr<const Snapshot>& emptySnapshot( void );
+
+         // Same as setValue() and removing the given knot from the map, respectively.
+         void insertKnot( double time, const T& value );
+         void eraseKnot( KnotIter knot );
+
+         // Inserts or removes the compiled entry of knot i, keeping
+         // the per-segment arrays consistent and marking the
+         // affected segments as dirty.
+         void insertCompiledKnot( size_t i, double time, const T& value );
+         void eraseCompiledKnot( size_t i );
+
+         // Marks segments first..last (inclusive, clamped to
+         // the valid range) as needing new coefficients.
+         void invalidateSegments( long first, long last );
+
+         // Computes the coefficients of segment i from its knots
+         // and their neighbors.
+         void computeSegment( size_t i );
+
+         // Cursor used by evaluate( time, derivative ).
+         Cursor playbackCursor;
+
          // Given a time between 0 and 1, evaluates a cubic polynomial with
          // the given endpoint and tangent values at the beginning (0) and
          // end (1) of the interval.  Optionally, one can request a derivative
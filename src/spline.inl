@@ -11,16 +11,535 @@ inline T Spline<T>::cubicSplineUnitInterval(
       double normalizedTime,
       int derivative )
 {
-   // TODO IMPLEMENT ME (TASK 1A)
-   return T();
+   const double t  = normalizedTime;
+   const double t2 = t*t;
+   const double t3 = t2*t;
+
+   // Hermite basis functions (or their derivatives) at t.
+   double h00, h10, h01, h11;
+   switch( derivative )
+   {
+      case 0:
+         h00 =  2.*t3 - 3.*t2 + 1.;
+         h10 =     t3 - 2.*t2 + t;
+         h01 = -2.*t3 + 3.*t2;
+         h11 =     t3 -    t2;
+         break;
+      case 1:
+         h00 =  6.*t2 - 6.*t;
+         h10 =  3.*t2 - 4.*t + 1.;
+         h01 = -6.*t2 + 6.*t;
+         h11 =  3.*t2 - 2.*t;
+         break;
+      case 2:
+         h00 =  12.*t - 6.;
+         h10 =   6.*t - 4.;
+         h01 = -12.*t + 6.;
+         h11 =   6.*t - 2.;
+         break;
+      default:
+         return T();
+   }
+
+   return h00*position0 + h10*tangent0 + h01*position1 + h11*tangent1;
 }
             
 // Returns a state interpolated between the values directly before and after the given time.
 template <class T>
 inline T Spline<T>::evaluate( double time, int derivative )
 {
-   // TODO IMPLEMENT ME (TASK 1B)
-   return T();
+   return evaluate( time, derivative, playbackCursor );
+}
+
+template <class T>
+inline T Spline<T>::evaluate( double time, int derivative, Cursor& cursor )
+{
+   compile();
+   return current.evaluate( time, derivative, cursor );
+}
+
+template <class T>
+inline T Spline<T>::Snapshot::evaluate( double time, int derivative, Cursor& cursor ) const
+{
+   switch( derivative )
+   {
+      case 0: return evaluate<0>( time, cursor );
+      case 1: return evaluate<1>( time, cursor );
+      case 2: return evaluate<2>( time, cursor );
+      default: return T();
+   }
+}
+
+template <class T>
+template <int D>
+inline T Spline<T>::evaluate( double time )
+{
+   return evaluate<D>( time, playbackCursor );
+}
+
+template <class T>
+template <int D>
+inline T Spline<T>::evaluate( double time, Cursor& cursor )
+{
+   compile();
+   return current.template evaluate<D>( time, cursor );
+}
+
+template <class T>
+template <int D>
+inline T Spline<T>::Snapshot::evaluate( double time, Cursor& cursor ) const
+{
+   size_t i;
+   double s;
+   if( !locateSegment( time, cursor, i, s ) )
+   {
+      // Outside of the knots (or with fewer than two knots),
+      // the spline is constant; an empty spline has no value.
+      if( knotValues.empty() || D != 0 )
+      {
+         return T();
+      }
+      return knotValues[i];
+   }
+
+   // Evaluate the cached cubic for the interval [t1,t2).
+   const T* c = &segmentCoefficients[ 4*i ];
+
+   switch( D )
+   {
+      case 0:
+         return c[0] + s*( c[1] + s*( c[2] + s*c[3] ) );
+      case 1:
+         return c[1] + s*( 2.*c[2] + s*( 3.*c[3] ) );
+      case 2:
+         return 2.*c[2] + s*( 6.*c[3] );
+      default:
+         return T();
+   }
+}
+
+template <class T>
+inline typename Spline<T>::Sample Spline<T>::evaluateAll( double time )
+{
+   return evaluateAll( time, playbackCursor );
+}
+
+template <class T>
+inline typename Spline<T>::Sample Spline<T>::evaluateAll( double time, Cursor& cursor )
+{
+   compile();
+   return current.evaluateAll( time, cursor );
+}
+
+template <class T>
+inline typename Spline<T>::Sample Spline<T>::Snapshot::evaluateAll( double time, Cursor& cursor ) const
+{
+   Sample result;
+   result.value = T();
+   result.d1    = T();
+   result.d2    = T();
+
+   size_t i;
+   double s;
+   if( !locateSegment( time, cursor, i, s ) )
+   {
+      // The spline is constant here, so both derivatives vanish.
+      if( !knotValues.empty() )
+      {
+         result.value = knotValues[i];
+      }
+      return result;
+   }
+
+   // Each expression matches the corresponding case of evaluate<D>(),
+   // so that the results are identical.
+   const T* c = &segmentCoefficients[ 4*i ];
+   result.value = c[0] + s*( c[1] + s*( c[2] + s*c[3] ) );
+   result.d1    = c[1] + s*( 2.*c[2] + s*( 3.*c[3] ) );
+   result.d2    = 2.*c[2] + s*( 6.*c[3] );
+   return result;
+}
+
+template <class T>
+inline void Spline<T>::evaluateMany( const double* times, T* out, size_t n, int derivative )
+{
+   compile();
+   current.evaluateMany( times, out, n, derivative );
+}
+
+// Evaluates each sample with a scalar Horner step, sharing one cursor
+// across the whole batch.
+template <class T>
+inline void Spline<T>::Snapshot::evaluateMany( const double* times, T* out, size_t n, int derivative ) const
+{
+   Cursor cursor;
+   for( size_t k = 0; k < n; k++ )
+   {
+      out[k] = evaluate( times[k], derivative, cursor );
+   }
+}
+
+#ifdef __SSE2__
+// Evaluates the given derivative of two cubics in power basis at once,
+// i.e., c0 + c1 s + c2 s^2 + c3 s^3 and its derivatives, lane by lane.
+inline __m128d cubicPowerBasisSSE( __m128d c0, __m128d c1, __m128d c2, __m128d c3,
+                                   __m128d s, int derivative )
+{
+   switch( derivative )
+   {
+      case 0:
+         return _mm_add_pd( c0, _mm_mul_pd( s,
+                _mm_add_pd( c1, _mm_mul_pd( s,
+                _mm_add_pd( c2, _mm_mul_pd( s, c3 ) ) ) ) ) );
+      case 1:
+         return _mm_add_pd( c1, _mm_mul_pd( s,
+                _mm_add_pd( _mm_mul_pd( _mm_set1_pd( 2. ), c2 ),
+                            _mm_mul_pd( s, _mm_mul_pd( _mm_set1_pd( 3. ), c3 ) ) ) ) );
+      case 2:
+         return _mm_add_pd( _mm_mul_pd( _mm_set1_pd( 2. ), c2 ),
+                            _mm_mul_pd( s, _mm_mul_pd( _mm_set1_pd( 6. ), c3 ) ) );
+      default:
+         return _mm_setzero_pd();
+   }
+}
+
+// Scalar splines evaluate two samples per SSE register.
+template <>
+inline void Spline<double>::Snapshot::evaluateMany( const double* times, double* out, size_t n, int derivative ) const
+{
+   Cursor cursor;
+   BatchSegment segment;
+   size_t k = 0;
+   for( ; k+1 < n; k += 2 )
+   {
+      size_t ia, ib;
+      double sa, sb;
+      bool insideA = locateBatchSegment( times[k  ], cursor, segment, ia, sa );
+      bool insideB = locateBatchSegment( times[k+1], cursor, segment, ib, sb );
+
+      // Samples outside the knots are rare; evaluate them one at a time.
+      if( !insideA || !insideB )
+      {
+         out[k  ] = evaluate( times[k  ], derivative, cursor );
+         out[k+1] = evaluate( times[k+1], derivative, cursor );
+         continue;
+      }
+
+      const double* a = &segmentCoefficients[ 4*ia ];
+      const double* b = &segmentCoefficients[ 4*ib ];
+      __m128d r = cubicPowerBasisSSE( _mm_set_pd( b[0], a[0] ),
+                                      _mm_set_pd( b[1], a[1] ),
+                                      _mm_set_pd( b[2], a[2] ),
+                                      _mm_set_pd( b[3], a[3] ),
+                                      _mm_set_pd( sb, sa ),
+                                      derivative );
+      _mm_storeu_pd( out+k, r );
+   }
+
+   for( ; k < n; k++ )
+   {
+      out[k] = evaluate( times[k], derivative, cursor );
+   }
+}
+
+// The two coordinates of a Vector2D fill one SSE register,
+// so each sample is a single vector Horner evaluation.
+template <>
+inline void Spline<Vector2D>::Snapshot::evaluateMany( const double* times, Vector2D* out, size_t n, int derivative ) const
+{
+   Cursor cursor;
+   BatchSegment segment;
+   for( size_t k = 0; k < n; k++ )
+   {
+      size_t i;
+      double s;
+      if( !locateBatchSegment( times[k], cursor, segment, i, s ) )
+      {
+         out[k] = evaluate( times[k], derivative, cursor );
+         continue;
+      }
+
+      const Vector2D* c = &segmentCoefficients[ 4*i ];
+      __m128d r = cubicPowerBasisSSE( _mm_loadu_pd( &c[0].x ),
+                                      _mm_loadu_pd( &c[1].x ),
+                                      _mm_loadu_pd( &c[2].x ),
+                                      _mm_loadu_pd( &c[3].x ),
+                                      _mm_set1_pd( s ),
+                                      derivative );
+      _mm_storeu_pd( &out[k].x, r );
+   }
+}
+#endif // __SSE2__
+
+// Same as locateSegment(), but first checks the segment found for the
+// previous sample of the batch, which costs just two comparisons.
+template <class T>
+inline bool Spline<T>::Snapshot::locateBatchSegment( double time, Cursor& cursor, BatchSegment& segment,
+                                                     size_t& i, double& s ) const
+{
+   if( segment.start <= time && time < segment.end )
+   {
+      i = segment.index;
+      s = time - segment.start;
+      return true;
+   }
+
+   if( !locateSegment( time, cursor, i, s ) )
+   {
+      return false;
+   }
+
+   segment.index = i;
+   segment.start = knotTimes[i];
+   segment.end   = knotTimes[i+1];
+   return true;
+}
+
+// Finds the segment containing the given time, and the offset of the time
+// from the beginning of that segment.  Returns false if the spline is
+// constant at this time (fewer than two knots, or a time outside the
+// knots), in which case i is the index of the knot whose value applies.
+template <class T>
+inline bool Spline<T>::Snapshot::locateSegment( double time, Cursor& cursor, size_t& i, double& s ) const
+{
+   const size_t n = knotTimes.size();
+
+   i = 0;
+   if( n < 2 )
+   {
+      return false;
+   }
+
+   // Locate the interval [t1,t2) containing the given time.
+   size_t i2 = findUpperKnot( time, cursor );
+
+   // Before the first knot, the spline is constant.
+   if( i2 == 0 )
+   {
+      return false;
+   }
+
+   if( i2 == n )
+   {
+      // After the last knot, the spline is constant.
+      if( time > knotTimes[n-1] )
+      {
+         i = n-1;
+         return false;
+      }
+
+      // Exactly at the last knot, we evaluate the end of the final interval.
+      i2 = n-1;
+   }
+
+   i = i2-1;
+   s = time - knotTimes[i];
+   return true;
+}
+
+// Returns the index of the first knot strictly after the given time,
+// starting the search from the interval remembered by the cursor.  When
+// the cursor is stale, or the query moved backwards or far ahead, we fall
+// back to a binary search of the compiled knot times.
+template <class T>
+inline size_t Spline<T>::Snapshot::findUpperKnot( double time, Cursor& cursor ) const
+{
+   // The number of intervals the cursor may step forward before
+   // we consider a fresh binary search to be cheaper.
+   const int maxCursorSteps = 4;
+
+   const size_t n = knotTimes.size();
+
+   if( cursor.valid && cursor.version == version && cursor.upper <= n )
+   {
+      size_t upper = cursor.upper;
+
+      // Only search forward from the remembered interval.
+      if( upper == 0 || knotTimes[upper-1] <= time )
+      {
+         for( int step = 0; step < maxCursorSteps; step++ )
+         {
+            if( upper == n || time < knotTimes[upper] )
+            {
+               cursor.upper = upper;
+               return upper;
+            }
+            upper++;
+         }
+      }
+   }
+
+   cursor.upper   = upper_bound( knotTimes.begin(), knotTimes.end(), time ) - knotTimes.begin();
+   cursor.version = version;
+   cursor.valid   = true;
+   return cursor.upper;
+}
+
+template <class T>
+inline shared_ptr<const typename Spline<T>::Snapshot> Spline<T>::snapshot( void )
+{
+   publish();
+   return published;
+}
+
+template <class T>
+inline shared_ptr<const typename Spline<T>::Snapshot> Spline<T>::publishedSnapshot( void ) const
+{
+   return atomic_load( &published );
+}
+
+template <class T>
+inline const shared_ptr<const typename Spline<T>::Snapshot>& Spline<T>::emptySnapshot( void )
+{
+   static const shared_ptr<const Snapshot> empty( new Snapshot() );
+   return empty;
+}
+
+// Readers that loaded the previous snapshot keep their reference to it,
+// so it is freed only once the last of them lets go.  (Only this thread
+// replaces "published", so it may read it without an atomic load.)
+template <class T>
+inline void Spline<T>::publish( void )
+{
+   if( published->version == current.version )
+   {
+      return;
+   }
+
+   compile();
+   shared_ptr<const Snapshot> copy( new Snapshot( current ) );
+   atomic_store( &published, copy );
+}
+
+// Recomputes the coefficients of all dirty segments.
+template <class T>
+inline void Spline<T>::compile( void )
+{
+   if( !coefficientsDirty )
+   {
+      return;
+   }
+
+   for( size_t i = 0; i < segmentDirty.size(); i++ )
+   {
+      if( segmentDirty[i] )
+      {
+         computeSegment( i );
+         segmentDirty[i] = false;
+      }
+   }
+
+   coefficientsDirty = false;
+}
+
+template <class T>
+inline void Spline<T>::computeSegment( size_t i )
+{
+   const vector<double>& knotTimes = current.knotTimes;
+   const vector<T>& knotValues = current.knotValues;
+   const size_t n = knotTimes.size();
+   const size_t i1 = i;
+   const size_t i2 = i+1;
+
+   const double t1 = knotTimes[i1];  const T& p1 = knotValues[i1];
+   const double t2 = knotTimes[i2];  const T& p2 = knotValues[i2];
+   const double dt = t2 - t1;
+
+   // Outer neighbors; at either end of the spline we reflect the
+   // current interval to obtain a virtual knot.
+   double t0, t3;
+   T p0, p3;
+   if( i1 == 0 )
+   {
+      t0 = t1 - dt;
+      p0 = p1 - ( p2 - p1 );
+   }
+   else
+   {
+      t0 = knotTimes[i1-1];
+      p0 = knotValues[i1-1];
+   }
+   if( i2+1 == n )
+   {
+      t3 = t2 + dt;
+      p3 = p2 + ( p2 - p1 );
+   }
+   else
+   {
+      t3 = knotTimes[i2+1];
+      p3 = knotValues[i2+1];
+   }
+
+   // Catmull-Rom tangents, rescaled to the unit interval.
+   T m1 = ( p2 - p0 ) * ( dt / ( t2 - t0 ) );
+   T m2 = ( p3 - p1 ) * ( dt / ( t3 - t1 ) );
+
+   // Power-basis form of the Hermite cubic on the unit interval,
+   // with each coefficient rescaled from normalized to actual time.
+   T* c = &current.segmentCoefficients[ 4*i ];
+   c[0] = p1;
+   c[1] = m1 / dt;
+   c[2] = ( 3.*( p2 - p1 ) - 2.*m1 - m2 ) / ( dt*dt );
+   c[3] = ( 2.*( p1 - p2 ) + m1 + m2 ) / ( dt*dt*dt );
+}
+
+template <class T>
+inline void Spline<T>::invalidateSegments( long first, long last )
+{
+   const long nSegments = segmentDirty.size();
+
+   first = max( first, 0L );
+   last  = min( last, nSegments-1 );
+
+   for( long i = first; i <= last; i++ )
+   {
+      segmentDirty[i] = true;
+      coefficientsDirty = true;
+   }
+}
+
+template <class T>
+inline void Spline<T>::insertCompiledKnot( size_t i, double time, const T& value )
+{
+   vector<double>& knotTimes = current.knotTimes;
+   vector<T>& knotValues = current.knotValues;
+   vector<T>& segmentCoefficients = current.segmentCoefficients;
+
+   knotTimes.insert( knotTimes.begin() + i, time );
+   knotValues.insert( knotValues.begin() + i, value );
+
+   // A new knot splits one segment into two (or, if it is the first
+   // or last knot, adds one segment at the end of the spline).
+   if( knotTimes.size() > 1 )
+   {
+      size_t segment = min( i, knotTimes.size()-2 );
+      segmentCoefficients.insert( segmentCoefficients.begin() + 4*segment, 4, T() );
+      segmentDirty.insert( segmentDirty.begin() + segment, true );
+   }
+
+   invalidateSegments( (long) i-2, (long) i+1 );
+}
+
+template <class T>
+inline void Spline<T>::eraseCompiledKnot( size_t i )
+{
+   vector<double>& knotTimes = current.knotTimes;
+   vector<T>& knotValues = current.knotValues;
+   vector<T>& segmentCoefficients = current.segmentCoefficients;
+
+   knotTimes.erase( knotTimes.begin() + i );
+   knotValues.erase( knotValues.begin() + i );
+
+   // Removing a knot merges its two adjacent segments into one.
+   if( !segmentDirty.empty() )
+   {
+      size_t segment = min( i, segmentDirty.size()-1 );
+      segmentCoefficients.erase( segmentCoefficients.begin() + 4*segment,
+                                 segmentCoefficients.begin() + 4*segment + 4 );
+      segmentDirty.erase( segmentDirty.begin() + segment );
+   }
+
+   invalidateSegments( (long) i-2, (long) i );
 }
 
 // Removes the knot closest to the given time,
@@ -39,7 +558,10 @@ inline bool Spline<T>::removeKnot(double time, double tolerance )
    typename std::map<double, T>::iterator t2_iter = knots.lower_bound(time);
    typename std::map<double, T>::iterator t1_iter;
    t1_iter = t2_iter;
-   t1_iter--;
+   if( t1_iter != knots.begin() )
+   {
+      t1_iter--;
+   }
 
    if( t2_iter == knots.end() )
    {
@@ -55,27 +577,141 @@ inline bool Spline<T>::removeKnot(double time, double tolerance )
    double d2 = fabs(t2 - time);
 
 
-   if(d1 < tolerance && d1 < d2)
+   if(d1 < tolerance && d1 <= d2)
    {
-      knots.erase(t1_iter);
+      eraseKnot(t1_iter);
       return true;
    }
 
    if(d2 < tolerance && d2 < d1)
    {
-      knots.erase(t2_iter);
-      return t2;
+      eraseKnot(t2_iter);
+      return true;
    }
 
    return false;
 }
 
+template <class T>
+inline void Spline<T>::eraseKnot( KnotIter knot )
+{
+   const vector<double>& knotTimes = current.knotTimes;
+
+   current.version++;
+   eraseCompiledKnot( lower_bound( knotTimes.begin(), knotTimes.end(), knot->first ) - knotTimes.begin() );
+   knots.erase( knot );
+}
+
+// Distance between two spline values, used to measure approximation error.
+inline double splineValueDistance( double a, double b ) { return fabs( a - b ); }
+inline double splineValueDistance( const Vector2D& a, const Vector2D& b ) { return ( a - b ).norm(); }
+
+// Greedily visits the interior knots from first to last, removing each one
+// whose absence keeps the spline within the tolerance of the original.
+// Since removing a knot only changes the two segments on either side of it,
+// and the segments adjacent to those (whose tangents depend on it), only
+// the original samples between the second knot before and the second knot
+// after need to be checked.
+template <class T>
+inline size_t Spline<T>::reduceKnots( double tolerance )
+{
+   if( knots.size() < 3 )
+   {
+      return 0;
+   }
+
+   // The original spline, against which all errors are measured
+   // (rather than against the progressively reduced spline, which
+   // would let the error accumulate beyond the tolerance).
+   // Nothing is published during the reduction (the caller publishes once
+   // it is done), so that concurrent readers only ever see the spline
+   // before or after the reduction.
+   shared_ptr<const Snapshot> original = snapshot();
+   const vector<double>& originalTimes = original->getKnotTimes();
+   Cursor originalCursor;
+
+   size_t nRemoved = 0;
+   KnotIter knot = next( knots.begin() );
+   KnotIter last = prev( knots.end() );
+   while( knot != last )
+   {
+      // Range of times affected by removing this knot.
+      KnotIter before = prev( knot );
+      KnotIter after  = next( knot );
+      double start = ( before == knots.begin() ? before : prev( before ) )->first;
+      double end   = ( after == last ? after : next( after ) )->first;
+
+      double time = knot->first;
+      T value = knot->second;
+      eraseKnot( knot );
+
+      // Compare the reduced and original splines at the original knot
+      // times within the affected range, and halfway between them.
+      bool withinTolerance = true;
+      size_t i = lower_bound( originalTimes.begin(), originalTimes.end(), start ) - originalTimes.begin();
+      for( ; withinTolerance && i < originalTimes.size() && originalTimes[i] <= end; i++ )
+      {
+         double t = originalTimes[i];
+         withinTolerance = splineValueDistance( evaluate( t ), original->evaluate( t, 0, originalCursor ) ) <= tolerance;
+
+         if( withinTolerance && i+1 < originalTimes.size() && originalTimes[i+1] <= end )
+         {
+            t = .5*( originalTimes[i] + originalTimes[i+1] );
+            withinTolerance = splineValueDistance( evaluate( t ), original->evaluate( t, 0, originalCursor ) ) <= tolerance;
+         }
+      }
+
+      if( withinTolerance )
+      {
+         nRemoved++;
+      }
+      else
+      {
+         insertKnot( time, value );
+      }
+
+      knot = after;
+   }
+
+   return nRemoved;
+}
+
 // Sets the value of the spline at a given time (i.e., knot),
 // creating a new knot at this time if necessary.
 template <class T>
 inline void Spline<T>::setValue( double time, T value )
 {
+   insertKnot( time, value );
+}
+
+template <class T>
+inline void Spline<T>::setValues( const double* times, const T* values, size_t n )
+{
+   for( size_t i = 0; i < n; i++ )
+   {
+      insertKnot( times[i], values[i] );
+   }
+}
+
+template <class T>
+inline void Spline<T>::insertKnot( double time, const T& value )
+{
+   vector<double>& knotTimes = current.knotTimes;
+
+   current.version++;
    knots[ time ] = value;
+
+   // Update the compiled copy of the knots.
+   size_t i = lower_bound( knotTimes.begin(), knotTimes.end(), time ) - knotTimes.begin();
+   if( i < knotTimes.size() && knotTimes[i] == time )
+   {
+      current.knotValues[i] = value;
+      invalidateSegments( (long) i-2, (long) i+1 );
+   }
+   else
+   {
+      insertCompiledKnot( i, time, value );
+   }
 }
 
 template <class T>
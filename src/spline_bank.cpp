@@ -0,0 +1,168 @@
+/*
+ * Implementation of the SplineBank class.
+ */
+
+#include "spline_bank.h"
+
+namespace CMU462
+{
+   void SplineBank::setChannels( const vector<Spline<double>*>& newChannels )
+   {
+      channels = newChannels;
+      built = false;
+   }
+
+   void SplineBank::evaluate( double time, double* values )
+   {
+      if( !built || isStale() )
+      {
+         rebuild();
+      }
+
+      for( size_t i = 0; i < constantChannels.size(); i++ )
+      {
+         values[ constantChannels[i] ] = constantValues[i];
+      }
+
+      for( vector<Group>::iterator g = groups.begin(); g != groups.end(); g++ )
+      {
+         const size_t nMembers = g->members.size();
+         const size_t nKnots = g->times.size();
+         double* result = &g->result[0];
+
+         if( time < g->times[0] )
+         {
+            // Before the first knot, each spline is constant.
+            for( size_t m = 0; m < nMembers; m++ ) result[m] = g->firstValues[m];
+         }
+         else if( time > g->times[nKnots-1] )
+         {
+            // After the last knot, each spline is constant.
+            for( size_t m = 0; m < nMembers; m++ ) result[m] = g->lastValues[m];
+         }
+         else
+         {
+            // Locate the segment once, then evaluate the cubic of every
+            // member with the same Horner scheme used by Spline::evaluate().
+            size_t j = findSegment( *g, time );
+            const double s = time - g->times[j];
+            const double* c0 = &g->coefficients[ 4*j*nMembers ];
+            const double* c1 = c0 + nMembers;
+            const double* c2 = c1 + nMembers;
+            const double* c3 = c2 + nMembers;
+
+            for( size_t m = 0; m < nMembers; m++ )
+            {
+               result[m] = c0[m] + s*( c1[m] + s*( c2[m] + s*c3[m] ) );
+            }
+         }
+
+         for( size_t m = 0; m < nMembers; m++ )
+         {
+            values[ g->members[m] ] = result[m];
+         }
+      }
+   }
+
+   size_t SplineBank::findSegment( Group& group, double time ) const
+   {
+      const vector<double>& t( group.times );
+      const size_t nSegments = t.size()-1;
+
+      // Playback moves forward, so try the last segment and its successor first.
+      size_t j = group.lastSegment;
+      for( int step = 0; step < 2 && j < nSegments; step++, j++ )
+      {
+         if( t[j] <= time && ( time < t[j+1] || j+1 == nSegments ) )
+         {
+            group.lastSegment = j;
+            return j;
+         }
+      }
+
+      // Otherwise, search for the first knot after the given time; a time
+      // exactly at the last knot belongs to the end of the final segment.
+      j = upper_bound( t.begin(), t.end(), time ) - t.begin();
+      j = min( max( j, (size_t) 1 ), nSegments ) - 1;
+      group.lastSegment = j;
+      return j;
+   }
+
+   bool SplineBank::isStale( void ) const
+   {
+      for( size_t i = 0; i < channels.size(); i++ )
+      {
+         if( channels[i] && channels[i]->getVersion() != versions[i] )
+         {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   void SplineBank::rebuild( void )
+   {
+      groups.clear();
+      constantChannels.clear();
+      constantValues.clear();
+      versions.resize( channels.size() );
+
+      // Sort the channels into groups with identical knot times.
+      for( size_t i = 0; i < channels.size(); i++ )
+      {
+         Spline<double>* spline = channels[i];
+         if( !spline )
+         {
+            continue;
+         }
+
+         spline->compile();
+         versions[i] = spline->getVersion();
+
+         const vector<double>& times = spline->getKnotTimes();
+         if( times.size() < 2 )
+         {
+            constantChannels.push_back( i );
+            constantValues.push_back( times.empty() ? 0. : spline->getKnotValues()[0] );
+            continue;
+         }
+
+         vector<Group>::iterator g = groups.begin();
+         while( g != groups.end() && g->times != times ) g++;
+         if( g == groups.end() )
+         {
+            groups.push_back( Group() );
+            g = groups.end()-1;
+            g->times = times;
+            g->lastSegment = 0;
+         }
+         g->members.push_back( i );
+      }
+
+      // Gather the coefficients of each group into struct-of-arrays form.
+      for( vector<Group>::iterator g = groups.begin(); g != groups.end(); g++ )
+      {
+         const size_t nMembers = g->members.size();
+         const size_t nSegments = g->times.size()-1;
+
+         g->coefficients.resize( 4*nSegments*nMembers );
+         g->firstValues.resize( nMembers );
+         g->lastValues.resize( nMembers );
+         g->result.resize( nMembers );
+
+         for( size_t m = 0; m < nMembers; m++ )
+         {
+            const Spline<double>* spline = channels[ g->members[m] ];
+            const vector<double>& c = spline->getSegmentCoefficients();
+            for( size_t k = 0; k < 4*nSegments; k++ )
+            {
+               g->coefficients[ k*nMembers + m ] = c[k];
+            }
+            g->firstValues[m] = spline->getKnotValues().front();
+            g->lastValues[m]  = spline->getKnotValues().back();
+         }
+      }
+
+      built = true;
+   }
+}
@@ -0,0 +1,96 @@
+#ifndef SPLINE_BANK_H
+#define SPLINE_BANK_H
+
+/*
+ * SplineBank class.
+ *
+ * Purpose : Evaluates a whole set of scalar splines (e.g., all keyframed
+ *           joint angles of a Character) at a common time in one pass.
+ *
+ * - Splines whose knots lie at the same times (which is the common case,
+ *   since keyframes are set for every joint at once) are grouped, so that
+ *   the knot interval is located only once per group.
+ * - Within a group, the cubic coefficients are stored in struct-of-arrays
+ *   form, so that evaluating all channels is a single contiguous loop.
+ * - The bank rebuilds itself automatically whenever any of its splines
+ *   has been modified since the last evaluation.
+ *
+ */
+
+#include <vector>
+#include "spline.h"
+
+using namespace std;
+
+namespace CMU462
+{
+   class SplineBank
+   {
+      public:
+         SplineBank() : built( false ) {}
+         ~SplineBank() {}
+
+         // Sets the splines evaluated by this bank.  Channel i of the bank
+         // corresponds to channels[i]; NULL entries are ignored by evaluate().
+         void setChannels( const vector<Spline<double>*>& channels );
+
+         // Number of channels, including NULL ones.
+         size_t size( void ) const { return channels.size(); }
+
+         // Evaluates every (non-NULL) channel at the given time, storing
+         // the value of channel i in values[i].  Entries for NULL channels
+         // are left untouched.  The results are identical to calling
+         // Spline::evaluate( time ) on each channel.
+         void evaluate( double time, double* values );
+
+      private:
+         // A set of channels whose splines share the same knot times.
+         struct Group
+         {
+            // knot times shared by all channels of this group
+            vector<double> times;
+
+            // index of each member in the bank's list of channels
+            vector<size_t> members;
+
+            // Coefficient k of segment j of member m is stored at
+            // coefficients[ (4*j + k)*members.size() + m ], i.e., for a
+            // given segment, each coefficient is a contiguous array over
+            // all members (see Spline::segmentCoefficients).
+            vector<double> coefficients;
+
+            // values of the first and last knots of each member,
+            // which the splines take before and after the knots
+            vector<double> firstValues;
+            vector<double> lastValues;
+
+            // segment used by the most recent evaluation
+            size_t lastSegment;
+
+            // scratch space holding one value per member
+            vector<double> result;
+         };
+
+         // Regroups the channels and copies their coefficients.
+         void rebuild( void );
+
+         // Returns true iff some spline changed since the last rebuild.
+         bool isStale( void ) const;
+
+         // Finds the segment of the group containing the given time.
+         size_t findSegment( Group& group, double time ) const;
+
+         vector<Spline<double>*> channels;
+         vector<unsigned long> versions; // spline versions at the last rebuild
+         vector<Group> groups;
+
+         // channels with fewer than two knots, and their (constant) values
+         vector<size_t> constantChannels;
+         vector<double> constantValues;
+
+         // false until the first rebuild
+         bool built;
+   };
+}
+
+#endif // SPLINE_BANK_H
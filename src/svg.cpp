@@ -827,10 +827,12 @@ double polygonArea(const vector<Vector2D> &points) {
   return fabs(area);
 }
 
+// Returns the second moment of area of the given polygon about the given
+// center, i.e., its moment of inertia for unit density, by summing the
+// (signed) moments of the triangles spanned by the center and each edge.
 double polygonMomentOfInertia(const Vector2D &center,
                               const vector<Vector2D> &points) {
   double I = 0.;
-  double d = 0.;
 
   int n = points.size();
   for (int i = 0; i < n; i++) {
@@ -839,14 +841,12 @@ double polygonMomentOfInertia(const Vector2D &center,
 
     Vector2D a = p - center;
     Vector2D b = q - center;
-    Vector2D m = (a + b) / 2.;
     double axb = (a.x * b.y - a.y * b.x);
 
-    I += (2. / 3.) * dot(m, m) * axb;
-    d += axb;
+    I += (dot(a, a) + dot(a, b) + dot(b, b)) * axb;
   }
 
-  return fabs(I / d);
+  return fabs(I / 12.);
 }
 
 Vector2D polygonCentroid(const vector<Vector2D> &points) {
@@ -905,7 +905,7 @@ double Rect::momentOfInertia(const Vector2D &center) const {
   points.push_back(p2);
   points.push_back(p3);
 
-  return rho * polygonMomentOfInertia(center, points);
+  return rho * polygonMomentOfInertia(Vector2D(0., 0.), points);
 }
 
 Vector2D Rect::centroid(void) const {
@@ -975,8 +975,8 @@ double Image::momentOfInertia(const Vector2D &center) const {
 
   Vector2D p0 = p;
   Vector2D p1 = p + w;
-  Vector2D p2 = p + h;
-  Vector2D p3 = p + w + h;
+  Vector2D p2 = p + w + h;
+  Vector2D p3 = p + h;
 
   vector<Vector2D> points;
   points.push_back(p0);
@@ -984,7 +984,7 @@ double Image::momentOfInertia(const Vector2D &center) const {
   points.push_back(p2);
   points.push_back(p3);
 
-  return rho * polygonMomentOfInertia(center, points);
+  return rho * polygonMomentOfInertia(Vector2D(0., 0.), points);
 }
 
 Vector2D Image::centroid(void) const {
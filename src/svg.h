@@ -154,6 +154,10 @@ struct Polygon : SVGElement {
   Polygon() : SVGElement  ( POLYGON ) { }
   std::vector<Vector2D> points;
 
+  // triangulation of the fill (as a triangle list), if computed ahead of
+  // time; otherwise empty, and the polygon is triangulated when drawn
+  std::vector<Vector2D> triangles;
+
   virtual SVGElement* copy( void ) const
   {
      return new Polygon( *this );
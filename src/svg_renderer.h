@@ -4,6 +4,7 @@
 #include <stdio.h>
 
 #include "CMU462/CMU462.h"
+#include "CMU462/affine2D.h"
 #include "svg.h"
 #include "viewport.h"
 #include <iostream>
@@ -16,7 +17,7 @@ class SVGRenderer {
 
   SVGRenderer()
   {
-     transformation.push( Matrix3x3::identity() );
+     transformation.push( Affine2Df::identity() );
   }
 
   // Free used resources
@@ -42,11 +43,11 @@ class SVGRenderer {
   {
      if( transformation.size() == 0 )
      {
-        transformation.push( Matrix3x3::identity() );
+        transformation.push( Affine2Df::identity() );
      }
      else
      {
-        transformation.top() = Matrix3x3::identity();
+        transformation.top() = Affine2Df::identity();
      }
   }
 
@@ -60,9 +61,15 @@ class SVGRenderer {
      transformation.pop();
   }
 
+  void concatenateTransformation( const Affine2D& X )
+  {
+     transformation.top() = transformation.top() * Affine2Df( X );
+  }
+
+  // (SVG element transformations are always affine.)
   void concatenateTransformation( const Matrix3x3& X )
   {
-     transformation.top() = transformation.top() * X;
+     transformation.top() = transformation.top() * Affine2Df( X );
   }
 
   // returns the color of the pixel closest to the specified coordinates
@@ -73,35 +80,20 @@ class SVGRenderer {
   // Viewport
   Viewport* viewport;
   
-  // Projective space transformation stack
-  std::stack<Matrix3x3> transformation;
+  // Affine transformation stack, in single precision
+  // since vertices are sent to OpenGL as floats
+  std::stack<Affine2Df> transformation;
 
   // Transform object coordinate to screen coordinate
   inline Vector2D transform( Vector2D p ) {
-
-    // map point from 2D Euclidean plane to 3D projective space
-    Vector3D u( p.x, p.y, 1.0 );
-
-    // apply projective space transformation
-    u = transformation.top() * u;
-
-    // project back to 2D Euclidean plane
-    return Vector2D(u.x / u.z, u.y / u.z);
+    return transformation.top() * p;
   }
 
   // Transform a vector that represents a direction rather than
   // a point (i.e., ignore translation and only apply rotation and
   // scaling)
   inline Vector2D transformDirection( Vector2D p ) {
-
-    // map point from 2D Euclidean plane to 3D projective space
-    Vector3D u( p.x, p.y, 0.0 );
-
-    // apply projective space transformation
-    u = transformation.top() * u;
-
-    // project back to 2D Euclidean plane
-    return Vector2D( u.x, u.y );
+    return transformation.top().transformDirection( p );
   }
 
 };